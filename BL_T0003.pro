@@ -8,7 +8,34 @@ SOURCES += \
     src/commands.c \
     src/cmd_def.c \
     src/main.cpp \
-    src/simpleserial.cpp
+    src/simpleserial.cpp \
+    src/hooks.cpp \
+    src/attscheduler.cpp \
+    src/txqueue.cpp \
+    src/eventexecutor.cpp \
+    src/handlerstats.cpp \
+    src/gattcache.cpp \
+    src/attributedb.cpp \
+    src/discovery.cpp \
+    src/readaggregator.cpp \
+    src/chainbuffer.cpp \
+    src/longattribute.cpp \
+    src/writestream.cpp \
+    src/notificationring.cpp \
+    src/timeseries.cpp \
+    src/subscriptions.cpp \
+    src/indications.cpp \
+    src/payloadschema.cpp \
+    src/streamops.cpp \
+    src/scanner.cpp \
+    src/advertisingdata.cpp \
+    src/scanfilter.cpp \
+    src/scanscheduler.cpp \
+    src/connectionmanager.cpp \
+    src/connectiontuner.cpp \
+    src/rssisampler.cpp \
+    src/channelmap.cpp \
+    src/fleetsweep.cpp
 
 OTHER_FILES += \
     README.md \
@@ -19,7 +46,35 @@ HEADERS += \
     inc/config.h \
     inc/cmd_def.h \
     inc/apitypes.h \
-    inc/simpleserial.h
+    inc/simpleserial.h \
+    inc/hooks.h \
+    inc/attscheduler.h \
+    inc/txqueue.h \
+    inc/eventexecutor.h \
+    inc/handlerstats.h \
+    inc/gattcache.h \
+    inc/attributedb.h \
+    inc/discovery.h \
+    inc/readaggregator.h \
+    inc/chainbuffer.h \
+    inc/longattribute.h \
+    inc/writestream.h \
+    inc/notificationring.h \
+    inc/timeseries.h \
+    inc/subscriptions.h \
+    inc/indications.h \
+    inc/payloadschema.h \
+    inc/streamops.h \
+    inc/scanner.h \
+    inc/advertisingdata.h \
+    inc/scanfilter.h \
+    inc/scanscheduler.h \
+    inc/connectionmanager.h \
+    inc/connectiontuner.h \
+    inc/rssisampler.h \
+    inc/channelmap.h \
+    inc/fleetsweep.h \
+    inc/steadyclock.h
 
 # C++11
 QMAKE_CXXFLAGS += -std=c++0x
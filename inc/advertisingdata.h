@@ -0,0 +1,123 @@
+#ifndef INC_ADVERTISINGDATA_H_
+#define INC_ADVERTISINGDATA_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Read-only view of the AD structures in advertising and scan response data
+ * (ble_msg_gap_scan_response_evt_t::data). Nothing is copied or allocated:
+ * accessors hand out pointers into the buffer, which has to outlive the view.
+ *
+ * Each structure is a length byte, a type byte and length - 1 bytes of data.
+ * Walking stops at a zero length (the rest is padding) or at a structure that
+ * would run past the end; the latter marks the data as malformed, structures
+ * before it are still returned.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./apitypes.h"
+
+
+/* AD types, Bluetooth Assigned Numbers */
+enum AdType {
+    kAdFlags = 0x01,
+    kAdIncompleteUuid16 = 0x02,
+    kAdCompleteUuid16 = 0x03,
+    kAdIncompleteUuid32 = 0x04,
+    kAdCompleteUuid32 = 0x05,
+    kAdIncompleteUuid128 = 0x06,
+    kAdCompleteUuid128 = 0x07,
+    kAdShortName = 0x08,
+    kAdCompleteName = 0x09,
+    kAdTxPower = 0x0A,
+    kAdServiceData16 = 0x16,
+    kAdServiceData32 = 0x20,
+    kAdServiceData128 = 0x21,
+    kAdManufacturerData = 0xFF
+};
+
+/* One AD structure, data points into the scanned buffer */
+struct AdStructure {
+    uint8 type;
+    uint8 len;
+    const uint8* data;
+};
+
+
+class AdIterator {
+    private:
+    const uint8* pos_;
+    const uint8* end_;
+    bool malformed_;
+
+    public:
+    AdIterator(const uint8* data, uint8 len);
+
+    bool Next(AdStructure* out);
+    bool Malformed() const { return malformed_; }
+};
+
+
+/* Walks the UUIDs of all service UUID lists, len is 2, 4 or 16 */
+class AdUuidIterator {
+    private:
+    AdIterator structures_;
+    AdStructure current_;
+    uint8 width_;
+    uint8 offset_;
+
+    public:
+    AdUuidIterator(const uint8* data, uint8 len);
+
+    bool Next(const uint8** uuid, uint8* len);
+};
+
+
+class AdvertisingData {
+    private:
+    const uint8* data_;
+    uint8 len_;
+
+    public:
+    AdvertisingData(const uint8* data, uint8 len) : data_(data), len_(len) {}
+
+    AdIterator Structures() const { return AdIterator(data_, len_); }
+    AdUuidIterator ServiceUuids() const { return AdUuidIterator(data_, len_); }
+
+    bool Find(uint8 type, AdStructure* out) const;
+    bool Malformed() const;
+
+    bool Flags(uint8* flags) const;
+    bool TxPower(int8* dbm) const;
+    bool LocalName(const char** name, uint8* len, bool* complete) const;
+    bool ManufacturerData(uint16* company, const uint8** data, uint8* len) const;
+    bool ServiceData(const uint8* uuid, uint8 uuid_len, const uint8** data, uint8* len) const;
+    bool HasService(const uint8* uuid, uint8 uuid_len) const;
+};
+
+
+#endif  // INC_ADVERTISINGDATA_H_
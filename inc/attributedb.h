@@ -0,0 +1,115 @@
+#ifndef INC_ATTRIBUTEDB_H_
+#define INC_ATTRIBUTEDB_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * The attributes of one connected device, built from the discovery events
+ * (as recorded or cached by GattCache). Attributes sit in an array sorted by
+ * handle; a hash index maps every UUID, 16-bit UUIDs widened with the
+ * Bluetooth base UUID, to its attributes. Each characteristic knows its
+ * value handle and CCCD, so "CCCD of characteristic X" is one hash lookup.
+ *
+ */
+
+
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./config.h"
+#include "./gattcache.h"
+
+
+/* 128-bit UUID, little endian like on air */
+struct Uuid {
+    uint8 bytes[16];
+
+    static Uuid FromBytes(const uint8* data, uint8 len);
+
+    bool operator==(const Uuid& other) const {
+        return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+    }
+};
+
+struct UuidHash {
+    size_t operator()(const Uuid& uuid) const;
+};
+
+/* What a handle is */
+enum AttEntryType {
+    kAttPrimaryService,
+    kAttSecondaryService,
+    kAttInclude,
+    kAttCharacteristicDeclaration,
+    kAttCharacteristicValue,
+    kAttDescriptor
+};
+
+/* One attribute of the database */
+struct AttEntry {
+    uint16 handle;
+    uint8 type;             // AttEntryType
+    Uuid uuid;
+    uint16 service;         // handle of the enclosing service declaration
+    uint16 service_end;     // last handle of the enclosing service
+    // characteristic values and declarations only
+    uint16 declaration;     // handle of the characteristic declaration
+    uint16 value;           // handle of the characteristic value
+    uint16 cccd;            // client characteristic configuration, 0 if none
+    uint8 properties;       // 0 if the declaration has not been read
+};
+
+
+class AttributeDb {
+    private:
+    std::vector<AttEntry> entries_;     // sorted by handle
+    std::unordered_map<Uuid, std::vector<uint32>, UuidHash> by_uuid_;
+
+    static AttributeDb dbs_[APP_MAX_CONNECTIONS];
+
+    public:
+    static AttributeDb* ForConnection(uint8 connection);
+
+    void Build(const std::vector<GattAttribute>& attributes);
+    void Clear();
+
+    bool Empty() const { return entries_.empty(); }
+    size_t Size() const { return entries_.size(); }
+    const std::vector<AttEntry>& Entries() const { return entries_; }
+
+    const AttEntry* FindByHandle(uint16 handle) const;
+    const AttEntry* FindService(const uint8* uuid, uint8 len) const;
+    const AttEntry* FindCharacteristic(const uint8* uuid, uint8 len) const;
+    std::vector<const AttEntry*> FindAll(const uint8* uuid, uint8 len) const;
+
+    uint16 ValueHandle(const uint8* uuid, uint8 len) const;
+    uint16 CccdHandle(const uint8* uuid, uint8 len) const;
+
+    void Print() const;
+};
+
+
+#endif  // INC_ATTRIBUTEDB_H_
@@ -0,0 +1,135 @@
+#ifndef INC_ATTSCHEDULER_H_
+#define INC_ATTSCHEDULER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * The BLE112 runs one attclient procedure per connection at a time, but the
+ * procedures of different connections run side by side. AttScheduler keeps a
+ * queue of GATT operations per connection and issues the next one as soon as
+ * the previous procedure on that link is over, so every link stays busy.
+ *
+ * Only one BGAPI command may be outstanding on the UART, so operations of all
+ * connections share a single command slot which is freed by the response.
+ * Commands that belong to no link's procedures (GAP, system) are queued on
+ * their own with SubmitCommand(), take the slot first and complete with their
+ * response, so they go out one at a time as well.
+ *
+ * Not thread safe: call everything from the thread that runs ReadBleMessage().
+ *
+ */
+
+
+#include <deque>
+#include <functional>
+
+#include "./apitypes.h"
+#include "./config.h"
+
+
+/* How the end of an operation is signalled by the dongle */
+enum AttCompletion {
+    kAttCompletesOnProcedure,       // ble_evt_attclient_procedure_completed
+    kAttCompletesOnValue,           // ble_evt_attclient_attribute_value (read)
+    kAttCompletesOnReadMultiple,    // ble_evt_attclient_read_multiple_response
+    kAttCompletesOnResponse         // the command response itself
+};
+
+/* Priority classes, served by weighted round robin except the idle one */
+enum AttPriority {
+    kAttPriorityHigh = 0,       // control traffic, e.g. CCCD writes
+    kAttPriorityNormal,         // application data
+    kAttPriorityBackground,     // discovery, housekeeping
+    kAttPriorityIdle,           // only when nothing else waits, e.g. RSSI
+    kAttPriorityCount
+};
+
+/* One queued GATT operation */
+struct AttOp {
+    AttPriority priority;
+    AttCompletion completion;
+    // sends the ble_cmd_attclient_* command, must capture its data by value
+    std::function<void(uint8 connection)> issue;
+    // called once with the BGAPI result (0 on success)
+    std::function<void(uint16 result)> done;
+    // keeps the link going instead of moving data, e.g. a channel map change
+    bool upkeep;
+};
+
+/* Per-connection counters */
+struct AttSchedulerStats {
+    uint32 issued;
+    uint32 data_issued;     // neither idle class nor upkeep
+    uint32 completed;
+    uint32 failed;
+    uint32 queued;
+};
+
+
+class AttScheduler {
+    private:
+    struct Link {
+        bool connected;
+        bool busy;
+        AttOp in_flight;
+        std::deque<AttOp> queue[kAttPriorityCount];
+        uint8 credit[kAttPriorityCount];
+        AttSchedulerStats stats;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+    static std::deque<AttOp> commands_;
+    static AttOp command_in_flight_;
+    static bool command_pending_;
+    static int command_connection_;     // kLocalCommand for SubmitCommand()
+    static uint8 next_connection_;
+
+    static const int kLocalCommand = -2;
+
+    static bool PopNext(Link* link, AttOp* op);
+    static void Finish(uint8 connection, uint16 result);
+
+    public:
+    // BGAPI result used when a link goes away with operations pending
+    static const uint16 kResultNotConnected = 0x0186;
+
+    static void Submit(uint8 connection, const AttOp& op);
+    static void SubmitCommand(const AttOp& op);
+    static void Pump();
+
+    static void OnConnected(uint8 connection);
+    static void OnDisconnected(uint8 connection);
+    static void OnResponse(uint8 connection, uint16 result);
+    static bool OnCommandResponse(uint16 result);
+    static bool OnProcedureCompleted(uint8 connection, uint16 result);
+    static void OnAttributeValue(uint8 connection, uint8 type);
+    static void OnReadMultipleResponse(uint8 connection);
+
+    static bool IsIdle();
+    static bool IsBusy(uint8 connection);
+    static uint32 QueueDepth(uint8 connection);
+    static AttSchedulerStats Stats(uint8 connection);
+};
+
+
+#endif  // INC_ATTSCHEDULER_H_
@@ -0,0 +1,63 @@
+#ifndef INC_CHAINBUFFER_H_
+#define INC_CHAINBUFFER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Growable byte buffer made of fixed-size segments. Appending never moves
+ * what is already stored, so segment pointers stay valid while the buffer
+ * grows and readers walk the segments instead of a flattened copy.
+ *
+ */
+
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "./apitypes.h"
+
+
+class ChainBuffer {
+    private:
+    std::vector<std::unique_ptr<uint8[]> > segments_;
+    size_t size_;
+
+    public:
+    static const size_t kSegmentSize = 256;
+
+    ChainBuffer();
+
+    void Append(const uint8* data, size_t len);
+    void Clear();
+
+    size_t Size() const { return size_; }
+    size_t SegmentCount() const { return segments_.size(); }
+    const uint8* Segment(size_t index, size_t* len) const;
+
+    size_t CopyOut(size_t offset, uint8* dst, size_t len) const;
+};
+
+
+#endif  // INC_CHAINBUFFER_H_
@@ -0,0 +1,160 @@
+#ifndef INC_CHANNELMAP_H_
+#define INC_CHANNELMAP_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Finds the data channels that cost a connection most of its retransmissions
+ * and takes them out of its channel map.
+ *
+ * The module cannot see per-channel errors, only the link layer counters of
+ * ble_cmd_system_get_counters (packets sent, retried, received, received
+ * broken) and the failed operations of AttScheduler. So it probes:
+ * the 37 data channels are split into the groups that overlap the Wi-Fi
+ * channels 1, 6 and 11, the usual source of interference. Each group in turn
+ * is left out of the map while the loss ratio is measured, and a group whose
+ * absence lowers the loss by more than a quarter in every round counts as
+ * persistently bad. The channels between the Wi-Fi channels are always kept.
+ *
+ * Goodput, the attribute value bytes received on the connection per second,
+ * is measured with the original map first and with the new map last. If the
+ * new map does worse, the original one is put back.
+ *
+ * The counters are shared by all connections, so the figures are clearest
+ * when the probed connection carries most of the traffic. One probe runs at
+ * a time and needs traffic during all of its windows; windows with too few
+ * packets are inconclusive and never exclude a group.
+ *
+ * The map reads and changes are queued with AttScheduler on the probed link,
+ * the counter reads as local commands, so they never collide with other
+ * commands. A map change that fails ends the probe and queues the original
+ * map again.
+ *
+ * Poll() reads the counters and moves the probe along, see steadyclock.h.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+struct ChannelMapStats {
+    uint32 probes;              // finished
+    uint8 map[5];               // in use, bit n for data channel n
+    uint8 channels;             // in use
+    uint32 loss_before;         // per mille of the packets, original map
+    uint32 loss_after;
+    uint32 goodput_before;      // bytes per second, original map
+    uint32 goodput_after;
+    bool reverted;              // the new map did worse
+};
+
+/* Gets 0 or the error that stopped the probe */
+typedef std::function<void(uint16 result, const ChannelMapStats& stats)> channel_map_done;
+
+
+class ChannelMapManager {
+    private:
+    enum Phase {
+        kPhaseIdle,
+        kPhaseReadMap,
+        kPhaseBefore,           // original map
+        kPhaseProbe,            // one group left out
+        kPhaseAfter             // new map
+    };
+
+    // what the outstanding get_counters is for, they reset on every read
+    enum CounterRead {
+        kCountersNone,
+        kCountersDiscard,       // end of the settling time
+        kCountersAdd,
+        kCountersClose          // end of the window
+    };
+
+    struct Window {
+        uint32 good;            // packets sent or received fine
+        uint32 lost;            // retried, received broken, failed operations
+        uint32 bytes;
+        uint32 failed_start;    // AttScheduler counter when measuring began
+        uint32 loss;            // per mille, once closed
+        bool valid;
+    };
+
+    static const int kGroups = 3;
+    static const int kRounds = 2;
+
+    static ChannelMapStats stats_[APP_MAX_CONNECTIONS];
+    static channel_map_done done_;
+    static int connection_;             // probed, -1 if none
+    static Phase phase_;
+    static int round_;
+    static int group_;
+    static bool measuring_;             // settled, counting
+    static uint64_t phase_end_ms_;
+    static uint64_t next_counters_ms_;
+    static CounterRead counters_pending_;
+    static uint32 window_ms_;
+    static Window window_;
+    static Window before_;
+    static uint32 probe_loss_[kRounds][kGroups];
+    static bool probe_valid_[kRounds][kGroups];
+    static uint8 original_[5];
+    static uint8 map_[5];               // being applied
+
+    static const uint32 kSettleMs = 500;
+    static const uint32 kCountersMs = 200;
+    static const uint32 kMinPackets = 50;
+    static const uint16 kResultNotConnected = 0x0186;
+
+    static int GroupOf(uint8 channel);
+    static void MapWithout(int group_mask, uint8* map);
+    static void Apply(uint8 connection, const uint8* map);
+    static void StartWindow(Phase phase, uint64_t now);
+    static void CloseWindow();
+    static void Next(uint64_t now);
+    static void Finish(uint16 result);
+    static void OnMapSet(uint8 connection, uint16 result);
+
+    public:
+    static void SetWindow(uint32 milliseconds);
+
+    static bool Start(uint8 connection, const channel_map_done& done);
+    static bool IsRunning();
+    static void Poll();
+
+    static void OnDisconnected(uint8 connection);
+    static void OnAttributeValue(uint8 connection, uint8 len);
+    static void OnCounters(const struct ble_msg_system_get_counters_rsp_t* msg);
+    static void OnMapRead(const struct ble_msg_connection_channel_map_get_rsp_t* msg);
+
+    static ChannelMapStats Stats(uint8 connection);
+};
+
+
+#endif  // INC_CHANNELMAP_H_
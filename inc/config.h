@@ -44,6 +44,7 @@
 // https://developer.bluetooth.org/gatt/characteristics/Pages/CharacteristicsHome.aspx
 #define GATT_DEVICENAME_UUID {0x00, 0x2A}
 #define GATT_APPEARANCE_UUID {0x01, 0x2A}
+#define GATT_SERVICE_CHANGED_UUID {0x05, 0x2A}
 
 // Attribute Value Types
 #define ATTCLIENT_ATTRIBUTE_VALUE_TYPE_READ 0
@@ -73,6 +74,9 @@
 #define APP_OK    0
 #define APP_FAILURE -1
 
+/* The BLE112 handles up to 8 simultaneous connections */
+#define APP_MAX_CONNECTIONS 8
+
 /* Little helpers */
 #define setFlag(target, flag) (target |= flag)
 #define clearFlag(target, flag) (target &= ~(flag))
@@ -0,0 +1,138 @@
+#ifndef INC_CONNECTIONMANAGER_H_
+#define INC_CONNECTIONMANAGER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Keeps a set of target devices connected. The targets that are neither
+ * connected nor backing off are kept in the dongle's whitelist, and a single
+ * ble_cmd_gap_connect_selective connects to whichever of them advertises
+ * first. Once a link is up the procedure is started again for the rest,
+ * until every target is connected or all links are in use.
+ *
+ * A target that disconnects is left out of the whitelist for a jittered,
+ * exponentially growing time before it is tried again, so a device that
+ * drops right away cannot keep the dongle busy and devices that went away
+ * together do not all come back at the same moment.
+ *
+ * The whitelist can only change while no GAP procedure runs, so a running
+ * connect_selective is ended first. Do not scan while the manager runs.
+ * The commands go through AttScheduler one at a time; Poll() does nothing
+ * while any of them is unanswered, so each step starts from what the dongle
+ * confirmed: a target counts as whitelisted once the append succeeded.
+ *
+ * Poll() brings the whitelist up to date, see steadyclock.h.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* As ble_cmd_gap_connect_selective takes them */
+struct ConnectionParameters {
+    uint16 interval_min;    // 1.25ms
+    uint16 interval_max;    // 1.25ms
+    uint16 timeout;         // 10ms
+    uint16 latency;         // connection events
+};
+
+struct ConnectionManagerStats {
+    uint32 targets;
+    uint32 connected;
+    uint32 connects;
+    uint32 disconnects;
+    uint32 selective_starts;
+    uint32 selective_failures;
+    uint32 whitelist_changes;
+    uint32 whitelist_failures;
+};
+
+
+class ConnectionManager {
+    private:
+    struct Target {
+        bd_addr address;
+        uint8 address_type;
+        bool connected;
+        uint8 connection;
+        bool whitelisted;
+        uint32 failures;            // disconnects since the last stable link
+        uint64_t connected_ms;
+        uint64_t next_attempt_ms;
+    };
+
+    static std::vector<Target> targets_;
+    static ConnectionParameters parameters_;
+    static uint32 max_links_;
+    static bool running_;
+    static bool connecting_;        // connect_selective is running
+    static uint32 outstanding_;     // commands not answered yet
+    static uint64_t retry_ms_;      // after a command failed
+    static ConnectionManagerStats stats_;
+    static std::mt19937 random_;
+
+    static const uint32 kBackoffBaseMs = 250;
+    static const uint32 kBackoffMaxMs = 30000;
+    static const uint32 kStableMs = 10000;  // a link that lasted resets the backoff
+    static const uint32 kRetryMs = 1000;
+
+    static Target* Find(const bd_addr& address, uint8 address_type);
+    static void Send(const std::function<void(uint8)>& issue,
+                     const std::function<void(uint16)>& done);
+    static void EndProcedure();
+    static void Whitelist(const Target& target, bool append);
+    static void Failed(uint16 result);
+
+    public:
+    static void SetParameters(const ConnectionParameters& parameters);
+    static void SetMaxLinks(uint32 links);
+    static uint32 MaxLinks() { return max_links_; }
+
+    static void AddTarget(const bd_addr& address, uint8 address_type);
+    static void RemoveTarget(const bd_addr& address, uint8 address_type);
+
+    static void Start();
+    static void Stop();
+    static bool IsRunning() { return running_; }
+
+    static void Poll();
+
+    static bool IsConnected(const bd_addr& address, uint8 address_type, uint8* connection);
+
+    static void OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+
+    static ConnectionManagerStats Stats();
+};
+
+
+#endif  // INC_CONNECTIONMANAGER_H_
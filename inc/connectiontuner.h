@@ -0,0 +1,128 @@
+#ifndef INC_CONNECTIONTUNER_H_
+#define INC_CONNECTIONTUNER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Adapts the connection interval of every link to its traffic with
+ * ble_cmd_connection_update. Each period the tuner counts the notifications
+ * and indications received and the data operations AttScheduler issued on a
+ * link (not RSSI reads or other upkeep), and looks at its queue depth:
+ *
+ *  - Under load the interval is set so that each connection event has a few
+ *    packets to carry; with a backlog in the queue it goes straight to the
+ *    fastest interval the policy allows.
+ *  - A link without traffic for a while is relaxed to the slowest interval,
+ *    with slave latency, so it costs next to no airtime.
+ *
+ * Updates are only sent for a change of more than a quarter, at most one
+ * per link at a time and not more often than kHoldMs, because each one takes
+ * several connection events to come into force. They are queued with
+ * AttScheduler like the link's other operations. An update the peer never
+ * answers with new parameters is given up after kPendingMs. The supervision
+ * timeout is raised where the spec requires it for the chosen interval and
+ * latency.
+ *
+ * Limits come from a policy per device address, or the default policy.
+ *
+ * Poll() looks at the links once a period, see steadyclock.h.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <map>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* Limits for one device, intervals in 1.25ms, timeout in 10ms */
+struct ConnectionPolicy {
+    uint16 fastest_interval;
+    uint16 slowest_interval;
+    uint16 idle_latency;        // slave latency once idle, 0 while busy
+    uint16 timeout;             // at least, raised as needed
+
+    static ConnectionPolicy Default();
+};
+
+struct ConnectionTunerStats {
+    uint32 updates;
+    uint32 rejected;            // connection_update failed
+    uint16 interval;            // current, 1.25ms
+    uint16 latency;
+    uint32 events_per_second;   // notifications plus ATT operations
+};
+
+
+class ConnectionTuner {
+    private:
+    struct Link {
+        bool connected;
+        uint64_t address;
+        ConnectionPolicy policy;
+        uint16 interval;
+        uint16 latency;
+        uint16 timeout;
+        uint32 notifications;       // since the last plan
+        uint32 last_issued;         // AttScheduler counter at the last plan
+        uint32 idle_periods;
+        bool pending;               // update sent, not reported back yet
+        uint64_t last_update_ms;
+        ConnectionTunerStats stats;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+    static std::map<uint64_t, ConnectionPolicy> policies_;
+    static ConnectionPolicy default_policy_;
+    static uint32 period_ms_;
+    static uint64_t next_plan_ms_;
+
+    static const uint32 kPacketsPerEvent = 4;
+    static const uint32 kIdlePeriods = 6;
+    static const uint32 kHoldMs = 2000;
+    static const uint32 kPendingMs = 4 * kHoldMs;
+
+    static uint64_t Key(const bd_addr& address);
+    static void Plan(uint8 connection, uint64_t now);
+    static void Update(uint8 connection, uint16 interval, uint16 latency, uint64_t now);
+
+    public:
+    static void SetDefaultPolicy(const ConnectionPolicy& policy);
+    static void SetPolicy(const bd_addr& address, const ConnectionPolicy& policy);
+    static void SetPeriod(uint32 milliseconds);
+
+    static void Poll();
+
+    static void OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+    static void OnNotification(uint8 connection);
+
+    static ConnectionTunerStats Stats(uint8 connection);
+};
+
+
+#endif  // INC_CONNECTIONTUNER_H_
@@ -0,0 +1,103 @@
+#ifndef INC_DISCOVERY_H_
+#define INC_DISCOVERY_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * GATT discovery with as few ATT round trips as possible, instead of walking
+ * every handle with find_information:
+ *  1. read_by_group_type on GATT_PRIMARY_SERVICE_UUID for the services
+ *  2. read_by_type on GATT_CHARACTERISTIC_DECLARATION_UUID per service, the
+ *     declarations carry properties, value handle and UUID
+ *  3. find_information only on the gaps behind a characteristic's value,
+ *     which is where its descriptors live
+ *
+ * Operations go through AttScheduler, so several connections discover at the
+ * same time. Results are recorded by GattCache; when a connection is done its
+ * cache entry is stored and its AttributeDb is built.
+ *
+ */
+
+
+#include <functional>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* What a discovery cost */
+struct DiscoveryStats {
+    uint32 procedures;      // host round trips (command + completion)
+    uint32 att_requests;    // estimated ATT request/response pairs on air
+    uint32 services;
+    uint32 characteristics;
+    uint32 descriptor_gaps;
+};
+
+typedef std::function<void(uint16 result, const DiscoveryStats& stats)> discovery_done;
+
+
+class Discovery {
+    private:
+    struct Range {
+        uint16 start;
+        uint16 end;
+    };
+
+    struct Link {
+        bool active;
+        bool reading_declarations;
+        uint32 outstanding;     // operations queued at AttScheduler
+        uint16 result;          // first error
+        uint32 found_short;     // entries with 16-bit UUID of the running procedure
+        uint32 found_long;      // entries with 128-bit UUID of the running procedure
+        std::vector<Range> services;
+        std::vector<Range> declarations;    // declaration handle, value handle
+        DiscoveryStats stats;
+        discovery_done done;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+
+    static void ReadServices(uint8 connection);
+    static void ReadCharacteristics(uint8 connection, const Range& service);
+    static void FindDescriptors(uint8 connection, const Range& gap);
+    static void Completed(uint8 connection, uint16 result, uint32 per_response);
+    static void Finish(uint8 connection);
+
+    public:
+    // ATT "Attribute Not Found" ends every search, it is not an error
+    static const uint16 kResultAttributeNotFound = 0x040A;
+
+    static bool Start(uint8 connection, const discovery_done& done);
+    static bool IsRunning(uint8 connection);
+
+    static void OnGroupFound(const struct ble_msg_attclient_group_found_evt_t* msg);
+    static void OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg);
+    static void OnInformationFound(const struct ble_msg_attclient_find_information_found_evt_t* msg);
+};
+
+
+#endif  // INC_DISCOVERY_H_
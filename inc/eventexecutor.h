@@ -0,0 +1,82 @@
+#ifndef INC_EVENTEXECUTOR_H_
+#define INC_EVENTEXECUTOR_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * The handlers in commands.c run inline in ReadBleMessage() and must stay
+ * short. Heavier post-processing (decoding, persisting, forwarding) can be
+ * registered here instead: ReadBleMessage() copies the payload of every
+ * message somebody subscribed to and returns to the UART right away, a pool
+ * of worker threads runs the processors.
+ *
+ * Messages are ordered by key. Connection and attclient messages use the
+ * connection handle as key, which keeps everything of one connection - and
+ * so of each of its characteristic handles - in arrival order. All other
+ * messages are ordered per message type. Each key maps to a strand, a strand
+ * runs on one worker at a time, and idle workers steal strands from busy ones.
+ *
+ * Post() neither allocates nor locks: each strand copies its messages into a
+ * ring of kStrandSlots preallocated tasks, and strands that become ready go
+ * through a lock free queue. A message whose strand's ring is full is
+ * dropped and counted by Dropped().
+ *
+ */
+
+
+#include <functional>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+
+
+// gets the payload as the message's struct, e.g. ble_msg_attclient_attribute_value_evt_t
+typedef std::function<void(const void* msg)> event_processor;
+
+
+class EventExecutor {
+    private:
+    static const int kMaxMessages = ble_evt_dfu_boot_idx + 1;
+
+    static std::vector<event_processor> processors_[kMaxMessages];
+    static bool running_;
+
+    static void Run(int msg_idx, const uint8* data);
+    static void WorkerLoop(unsigned worker);
+
+    public:
+    // not thread safe, subscribe everything before Start()
+    static void Subscribe(int msg_idx, const event_processor& processor);
+
+    static void Start(unsigned threads);
+    static void Stop();
+
+    static void Post(const struct ble_msg* api_msg, const uint8* data, uint8 len);
+
+    static uint32 Backlog();
+    static uint32 Dropped();
+};
+
+
+#endif  // INC_EVENTEXECUTOR_H_
@@ -0,0 +1,163 @@
+#ifndef INC_FLEETSWEEP_H_
+#define INC_FLEETSWEEP_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Reads the same characteristics from a list of devices: connect, read,
+ * disconnect, for every device, as fast as the radio allows.
+ *
+ * Devices are handed to ConnectionManager a few at a time, so connection
+ * setup for the next devices overlaps with the reads on the links already
+ * up and every connection slot stays busy. A device seen before is read
+ * right away with its cached layout; any other one is discovered first, and
+ * the layout is cached for the next sweep. The reads of a device go through
+ * ReadAggregator and its link is dropped as soon as the last value is in.
+ *
+ * A device that does not connect in time, or takes too long altogether,
+ * fails with kResultTimeout, one whose link is lost on the way with
+ * AttScheduler::kResultNotConnected.
+ *
+ * The disconnects go through AttScheduler as local commands. One that fails
+ * or brings no disconnected event within kDisconnectMs is sent again; after
+ * kDisconnectTries the device is given up with kResultTimeout, its link may
+ * then stay up.
+ *
+ * Poll() drives the sweep and polls ConnectionManager and ReadAggregator
+ * as well, see steadyclock.h.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+struct SweepDevice {
+    bd_addr address;
+    uint8 address_type;
+};
+
+struct SweepCharacteristic {
+    uint8 uuid[16];         // little endian
+    uint8 uuid_len;         // 2 or 16
+};
+
+/* Outcome for one device, times in milliseconds */
+struct SweepResult {
+    SweepDevice device;
+    uint16 result;          // 0 or the first error
+    bool cache_hit;
+    uint32 connect_ms;      // queued until connected
+    uint32 read_ms;         // connected until all values read
+    uint32 total_ms;        // queued until disconnected
+    uint32 missing;         // characteristics the device does not have
+    std::vector<std::vector<uint8> > values;   // per characteristic, empty if missing
+};
+
+typedef std::function<void(const SweepResult& result)> sweep_result_sink;
+
+struct FleetSweepStats {
+    uint32 devices;
+    uint32 done;
+    uint32 failed;
+    uint32 cache_hits;
+    uint64_t elapsed_ms;
+    uint32 latency_min_ms;  // total_ms of the successful devices
+    uint32 latency_max_ms;
+    uint64_t latency_sum_ms;
+    double devices_per_minute;
+};
+
+
+class FleetSweep {
+    private:
+    enum JobState {
+        kJobWaiting,        // a target of ConnectionManager
+        kJobDiscovering,
+        kJobReading,
+        kJobDisconnecting
+    };
+
+    struct Job {
+        JobState state;
+        uint8 connection;
+        uint32 reads;       // outstanding
+        uint64_t queued_ms;
+        uint64_t connect_deadline_ms;   // moved on while all links are taken
+        uint64_t connected_ms;
+        uint64_t disconnect_ms; // last disconnect sent
+        uint8 disconnects;      // sent so far
+        SweepResult result;
+    };
+
+    static std::vector<SweepDevice> devices_;
+    static std::vector<SweepCharacteristic> characteristics_;
+    static sweep_result_sink sink_;
+    static std::vector<Job> jobs_;
+    static size_t next_device_;
+    static uint64_t started_ms_;
+    static uint64_t finished_ms_;
+    static uint64_t last_poll_ms_;
+    static uint32 connect_timeout_ms_;
+    static uint32 device_timeout_ms_;
+    static FleetSweepStats stats_;
+
+    static const size_t kMaxWaiting = 8;
+    static const uint32 kDisconnectMs = 2000;
+    static const uint8 kDisconnectTries = 3;
+
+    static Job* ForConnection(uint8 connection);
+    static void Connected(Job* job, uint8 connection, uint64_t now);
+    static void Read(uint8 connection);
+    static void ValueRead(uint8 connection, size_t index, uint16 result,
+                          const uint8* data, uint8 len);
+    static void Disconnect(Job* job, uint16 result);
+    static void SendDisconnect(Job* job, uint64_t now);
+    static void Disconnected(uint8 connection, uint16 result);
+    static void Finish(size_t job, uint64_t now);
+
+    public:
+    static const uint16 kResultTimeout = 0x0185;
+
+    static void SetTimeouts(uint32 connect_ms, uint32 device_ms);
+
+    static bool Start(const std::vector<SweepDevice>& devices,
+                      const std::vector<SweepCharacteristic>& characteristics,
+                      const sweep_result_sink& sink);
+    static bool IsRunning();
+    static void Poll();
+
+    static void OnDisconnected(uint8 connection);
+
+    static FleetSweepStats Stats();
+};
+
+
+#endif  // INC_FLEETSWEEP_H_
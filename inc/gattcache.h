@@ -0,0 +1,106 @@
+#ifndef INC_GATTCACHE_H_
+#define INC_GATTCACHE_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * On-disk cache of discovered services, characteristics and descriptors,
+ * one file per device named after bd_addr and address type. The file is
+ * memory-mapped when the device connects; on a hit the application can skip
+ * find_information/read_by_group_type altogether.
+ *
+ * While a connection has no cache hit every discovery event is recorded and
+ * Store() writes it out. An indication of the Service Changed characteristic
+ * or an "invalid handle" error drops the entry.
+ *
+ */
+
+
+#include <string>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* What a discovery event told us about a handle */
+enum GattAttributeKind {
+    kGattService = 0,           // ble_evt_attclient_group_found
+    kGattAttribute = 1,         // ble_evt_attclient_find_information_found
+    kGattCharacteristic = 2     // ble_evt_attclient_attribute_found
+};
+
+/* One discovered attribute, also the on-disk record (24 byte, no padding) */
+struct GattAttribute {
+    uint16 handle;      // attribute handle, declaration handle for characteristics
+    uint16 end;         // last handle of a service, value handle of a characteristic
+    uint8 kind;         // GattAttributeKind
+    uint8 properties;   // characteristic properties
+    uint8 uuid_len;     // 2 or 16
+    uint8 reserved;
+    uint8 uuid[16];     // little endian, as sent by the dongle
+};
+
+
+class GattCache {
+    private:
+    struct Link {
+        bool connected;
+        bool hit;
+        bd_addr address;
+        uint8 address_type;
+        uint16 service_changed_handle;
+        std::vector<GattAttribute> attributes;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+    static std::string directory_;
+
+    static std::string FileName(const bd_addr& address, uint8 address_type);
+    static bool Load(Link* link);
+    static uint16 ServiceChangedHandle(const GattAttribute& attribute);
+
+    public:
+    // BGAPI result for ATT error "Invalid Handle"
+    static const uint16 kResultInvalidHandle = 0x0401;
+
+    static void SetDirectory(const std::string& directory);
+
+    static bool IsHit(uint8 connection);
+    static const std::vector<GattAttribute>* Attributes(uint8 connection);
+    static void Record(uint8 connection, const GattAttribute& attribute);
+    static bool Store(uint8 connection);
+    static void Invalidate(uint8 connection);
+
+    static void OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+    static void OnGroupFound(const struct ble_msg_attclient_group_found_evt_t* msg);
+    static void OnInformationFound(const struct ble_msg_attclient_find_information_found_evt_t* msg);
+    static void OnAttributeFound(const struct ble_msg_attclient_attribute_found_evt_t* msg);
+    static void OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg);
+    static void OnProcedureCompleted(uint8 connection, uint16 result);
+};
+
+
+#endif  // INC_GATTCACHE_H_
@@ -0,0 +1,89 @@
+#ifndef INC_HANDLERSTATS_H_
+#define INC_HANDLERSTATS_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Call count, CPU time and payload bytes of the commands.c handler of every
+ * message type, measured around api_msg->handler() in ReadBleMessage().
+ * Only the reader thread records; snapshots may be taken from any thread.
+ * Reset() only asks for a reset, the reader applies it before its next
+ * record, so the counters keep a single writer.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+
+
+/* Counters of one message type */
+struct HandlerStatsEntry {
+    int msg_idx;            // enum ble_msg_idx
+    struct ble_header hdr;  // class, command and rsp/evt of the message
+    uint64_t calls;
+    uint64_t total_ns;      // CPU time spent in the handler
+    uint64_t max_ns;
+    uint64_t bytes;         // payload bytes handed to the handler
+};
+
+
+class HandlerStats {
+    private:
+    static const int kMaxMessages = ble_evt_dfu_boot_idx + 1;
+
+    struct Counters {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> total_ns;
+        std::atomic<uint64_t> max_ns;
+        std::atomic<uint64_t> bytes;
+    };
+
+    static Counters counters_[kMaxMessages];
+    static std::atomic<uint32> reset_requested_;    // generation asked for
+    static std::atomic<uint32> reset_applied_;      // generation in the counters
+    static uint64_t report_interval_ns_;
+    static uint64_t next_report_ns_;
+
+    static uint64_t WallNow();
+
+    public:
+    static uint64_t Now();
+    static void Record(const struct ble_msg* api_msg, uint32 bytes, uint64_t start_ns);
+
+    static std::vector<HandlerStatsEntry> Snapshot();
+    static void Print(FILE* out);
+    static void Reset();
+
+    static void SetReportInterval(uint32 seconds);
+    static void MaybeReport();
+};
+
+
+#endif  // INC_HANDLERSTATS_H_
@@ -0,0 +1,64 @@
+#ifndef INC_HOOKS_H_
+#define INC_HOOKS_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * The BGLib handlers in commands.c are plain C. These hooks are the only way
+ * for them to reach the C++ parts of the application; hooks.cpp forwards each
+ * call to whichever classes are interested in the message.
+ *
+ */
+
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hook_rsp_attclient(uint8 connection, uint16 result);
+int hook_rsp_command(uint16 result);
+void hook_rsp_attclient_indicate_confirm(uint16 result);
+void hook_rsp_connection(uint8 connection, uint16 result);
+void hook_rsp_connection_get_rssi(uint8 connection, int8 rssi);
+void hook_rsp_connection_channel_map_get(const struct ble_msg_connection_channel_map_get_rsp_t *msg);
+void hook_rsp_system_get_counters(const struct ble_msg_system_get_counters_rsp_t *msg);
+
+void hook_evt_connection_status(const struct ble_msg_connection_status_evt_t *msg);
+void hook_evt_connection_disconnected(const struct ble_msg_connection_disconnected_evt_t *msg);
+int hook_evt_attclient_procedure_completed(const struct ble_msg_attclient_procedure_completed_evt_t *msg);
+void hook_evt_attclient_attribute_value(const struct ble_msg_attclient_attribute_value_evt_t *msg);
+void hook_evt_attclient_group_found(const struct ble_msg_attclient_group_found_evt_t *msg);
+void hook_evt_attclient_find_information_found(const struct ble_msg_attclient_find_information_found_evt_t *msg);
+void hook_evt_attclient_attribute_found(const struct ble_msg_attclient_attribute_found_evt_t *msg);
+void hook_evt_attclient_read_multiple_response(const struct ble_msg_attclient_read_multiple_response_evt_t *msg);
+void hook_evt_gap_scan_response(const struct ble_msg_gap_scan_response_evt_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif  // INC_HOOKS_H_
@@ -0,0 +1,85 @@
+#ifndef INC_INDICATIONS_H_
+#define INC_INDICATIONS_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Confirms indications that ask for it (ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE_RSP_REQ)
+ * with ble_cmd_attclient_indicate_confirm as soon as the event is read, before
+ * the payload is handed on. The peer may not send its next indication until
+ * it got the confirmation, so waiting for the application would throttle an
+ * indicating sensor to the speed of the consumer.
+ *
+ * The confirmation does not go through AttScheduler: it is not an ATT
+ * request, its response has a handler of its own, and queueing it behind a
+ * long procedure would stall the peer just the same.
+ *
+ * The time from the event to ble_rsp_attclient_indicate_confirm is measured.
+ * That response carries no connection handle, so confirmations are matched
+ * to responses in the order they were sent.
+ *
+ * Not thread safe: call everything from the thread that runs ReadBleMessage().
+ *
+ */
+
+
+#include <stdint.h>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+struct IndicationStats {
+    uint32 indications;     // events that asked for a confirmation
+    uint32 confirmed;       // confirmations the dongle accepted
+    uint32 failed;          // confirmations the dongle rejected
+    uint64_t latency_sum_us;
+    uint32 latency_min_us;
+    uint32 latency_max_us;
+};
+
+
+class IndicationConfirmer {
+    private:
+    struct Pending {
+        uint8 connection;
+        uint64_t time_us;
+    };
+
+    // the peer waits for each confirmation, so there is at most one per link
+    static Pending pending_[APP_MAX_CONNECTIONS];
+    static uint8 head_;
+    static uint8 count_;
+    static IndicationStats stats_[APP_MAX_CONNECTIONS];
+
+
+    public:
+    static void OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg);
+    static void OnConfirmResponse(uint16 result);
+
+    static IndicationStats Stats(uint8 connection);
+};
+
+
+#endif  // INC_INDICATIONS_H_
@@ -0,0 +1,93 @@
+#ifndef INC_LONGATTRIBUTE_H_
+#define INC_LONGATTRIBUTE_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Values longer than one ATT PDU.
+ *
+ * Read() runs attclient_read_long; the dongle reports the value in blob
+ * fragments of up to 22 bytes which are appended to a ChainBuffer, so the
+ * value is never limited by value_buffer and never copied again.
+ *
+ * Write() splits the value into prepare_write requests of 18 bytes and
+ * commits them with execute_write. Each request is issued the moment the
+ * previous one is acknowledged, ATT allows only one per link at a time. A
+ * failed request cancels the queued writes on the remote side.
+ *
+ */
+
+
+#include <functional>
+#include <memory>
+
+#include "./apitypes.h"
+#include "./chainbuffer.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+typedef std::shared_ptr<ChainBuffer> chain_buffer_ptr;
+
+/* Gets the reassembled value, empty on error */
+typedef std::function<void(uint16 result, const chain_buffer_ptr& value)> long_read_done;
+/* Gets 0 once the value is committed, otherwise the first error */
+typedef std::function<void(uint16 result)> long_write_done;
+
+
+class LongAttribute {
+    private:
+    struct Link {
+        uint16 reading;             // handle of the running read_long, 0 if none
+        chain_buffer_ptr value;     // fragments received so far
+    };
+
+    struct PendingWrite {
+        uint8 connection;
+        uint16 handle;
+        uint32 offset;              // of the next prepare_write
+        uint16 result;
+        chain_buffer_ptr value;
+        long_write_done done;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+
+    static void PrepareNext(const std::shared_ptr<PendingWrite>& write);
+    static void Execute(const std::shared_ptr<PendingWrite>& write, uint8 commit);
+
+    public:
+    // ATT_MTU 23 less opcode, handle and offset
+    static const uint8 kPrepareWriteChunk = 18;
+
+    static void Read(uint8 connection, uint16 handle, const long_read_done& done);
+    static void Write(uint8 connection, uint16 handle, const chain_buffer_ptr& value,
+                      const long_write_done& done);
+    static void Write(uint8 connection, uint16 handle, const uint8* data, size_t len,
+                      const long_write_done& done);
+
+    static void OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg);
+};
+
+
+#endif  // INC_LONGATTRIBUTE_H_
@@ -0,0 +1,97 @@
+#ifndef INC_NOTIFICATIONRING_H_
+#define INC_NOTIFICATIONRING_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Every notification and indication is stored as a record in a preallocated
+ * ring, so a burst that arrives before the application looks is not lost the
+ * way value_buffer loses it. Consumers take records in batches with Drain().
+ *
+ * When the ring is full the drop policy decides whether the new record or the
+ * oldest one is lost; either way it is counted.
+ *
+ * Push() runs on the thread of ReadBleMessage(), Drain() may run on any
+ * thread.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "./apitypes.h"
+
+
+/* One notification or indication */
+struct Notification {
+    uint64_t timestamp_ns;  // steady clock, when the event was read
+    uint8 connection;
+    uint8 type;             // ATTCLIENT_ATTRIBUTE_VALUE_TYPE_*
+    uint16 handle;
+    uint8 len;
+    uint8 data[22];         // ATT_MTU 23 less opcode
+};
+
+enum NotificationDropPolicy {
+    kDropNewest,            // keep what is queued, lose the incoming record
+    kDropOldest             // overwrite the oldest record
+};
+
+struct NotificationRingStats {
+    uint64_t pushed;
+    uint64_t drained;
+    uint64_t dropped;
+    uint64_t truncated;     // payload longer than a record holds
+    uint32 high_water;      // most records queued at once
+    uint32 capacity;
+};
+
+
+class NotificationRing {
+    private:
+    static std::vector<Notification> ring_;
+    static size_t head_;    // next record to drain
+    static size_t count_;
+    static NotificationDropPolicy policy_;
+    static NotificationRingStats stats_;
+    static std::mutex mutex_;
+
+    public:
+    static const size_t kDefaultCapacity = 1024;
+
+    static void Init(size_t capacity, NotificationDropPolicy policy);
+
+    static void Push(uint8 connection, uint8 type, uint16 handle,
+                     const uint8* data, uint8 len);
+    static size_t Drain(Notification* out, size_t max);
+    static size_t Size();
+
+    static NotificationRingStats Stats();
+};
+
+
+#endif  // INC_NOTIFICATIONRING_H_
@@ -0,0 +1,122 @@
+#ifndef INC_PAYLOADSCHEMA_H_
+#define INC_PAYLOADSCHEMA_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Declarative layout of characteristic values. A schema lists the fields of a
+ * value (position, type, byte order, scale and offset) and is registered per
+ * characteristic UUID. On registration every field is bound to a reader
+ * specialised for its type and byte order, so decoding does no switching.
+ *
+ * Besides decoding one value into doubles, a schema turns a batch of
+ * notification records into one column per field: the raw integers are
+ * gathered first, then scaled to floats four at a time with SSE2 where the
+ * compiler targets it.
+ *
+ * Register() is not thread safe, decoding with a registered schema is.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./attributedb.h"
+#include "./notificationring.h"
+
+
+enum PayloadFieldType {
+    kFieldUint8,
+    kFieldInt8,
+    kFieldUint16,
+    kFieldInt16,
+    kFieldUint24,
+    kFieldInt24,
+    kFieldUint32,
+    kFieldInt32,
+    kFieldFloat32       // IEEE 754, scale and offset still apply
+};
+
+enum PayloadByteOrder {
+    kLittleEndian,      // what GATT uses
+    kBigEndian
+};
+
+/* One field of a value, decoded as raw * scale + offset */
+struct PayloadField {
+    std::string name;
+    uint8 position;     // byte offset in the value
+    uint8 type;         // PayloadFieldType
+    uint8 order;        // PayloadByteOrder
+    double scale;
+    double offset;
+};
+
+
+class PayloadSchema {
+    private:
+    // raw field value, floats are passed through bit for bit
+    typedef int32_t (*field_reader)(const uint8* data);
+
+    struct CompiledField {
+        PayloadField field;
+        uint8 size;
+        field_reader read;
+    };
+
+    std::vector<CompiledField> fields_;
+    uint8 min_len_;
+
+    static std::unordered_map<Uuid, PayloadSchema, UuidHash> schemas_;
+
+    static const size_t kChunk = 256;
+
+    static void ScaleColumn(const int32_t* raw, size_t count, uint8 type,
+                            float scale, float offset, float* out);
+
+    public:
+    static uint8 FieldSize(uint8 type);
+
+    static bool Register(const uint8* uuid, uint8 len, const std::vector<PayloadField>& fields);
+    static const PayloadSchema* ForUuid(const uint8* uuid, uint8 len);
+
+    size_t FieldCount() const { return fields_.size(); }
+    const PayloadField& Field(size_t i) const { return fields_[i].field; }
+    uint8 MinLength() const { return min_len_; }
+
+    bool Decode(const uint8* data, uint8 len, double* out) const;
+    bool DecodeField(const uint8* data, uint8 len, size_t field, double* out) const;
+    size_t DecodeColumn(const Notification* records, size_t count, size_t field,
+                        float* out) const;
+    size_t DecodeRaw(const Notification* records, size_t count, size_t field,
+                     int32_t* out) const;
+};
+
+
+#endif  // INC_PAYLOADSCHEMA_H_
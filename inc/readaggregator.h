@@ -0,0 +1,113 @@
+#ifndef INC_READAGGREGATOR_H_
+#define INC_READAGGREGATOR_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Batches reads of fixed-length characteristics. Reads on the same connection
+ * are collected for a short window and sent as one attclient_read_multiple;
+ * the response is the concatenation of all values, so it is split back by the
+ * lengths the callers gave. Polling ten 2-byte sensors is one ATT round trip
+ * instead of ten.
+ *
+ * A batch is sent when its response would not fit into one ATT PDU anymore,
+ * when the window of its first read expired (see Poll()), or on Flush(). A
+ * read of unknown length, or a batch of one, is a plain read by handle.
+ *
+ * Not thread safe: call everything from the thread that runs ReadBleMessage().
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* Gets the value of one read, data is only valid during the call */
+typedef std::function<void(uint16 result, const uint8* data, uint8 len)> read_done;
+
+/* Per-connection counters */
+struct ReadAggregatorStats {
+    uint32 reads;
+    uint32 batches;         // read_multiple procedures
+    uint32 singles;         // read_by_handle procedures
+    uint32 failed;
+};
+
+
+class ReadAggregator {
+    private:
+    struct PendingRead {
+        uint16 handle;
+        uint8 length;
+        read_done done;
+    };
+
+    typedef std::shared_ptr<std::vector<PendingRead> > Batch;
+
+    struct Link {
+        std::vector<PendingRead> pending;
+        uint32 pending_bytes;
+        uint64_t window_start_ns;
+        bool in_flight;
+        uint8 value[32];        // response of the in-flight procedure
+        uint8 value_len;
+        ReadAggregatorStats stats;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+    static uint32 window_ms_;
+
+    static void Submit(uint8 connection, const Batch& batch);
+    static void Complete(uint8 connection, const Batch& batch, uint16 result);
+    static void Fail(std::vector<PendingRead>* reads, uint16 result);
+
+    public:
+    // ATT_MTU 23: a response holds 22 value bytes, a request 11 handles
+    static const uint8 kMaxPayload = 22;
+    static const uint8 kMaxHandles = 11;
+    // ATT error "Invalid Attribute Value Length", the response did not add up
+    static const uint16 kResultInvalidLength = 0x040D;
+
+    static void SetWindow(uint32 milliseconds);
+
+    static void Read(uint8 connection, uint16 handle, uint8 length, const read_done& done);
+    static void Flush(uint8 connection);
+    static void Poll();
+
+    static void OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg);
+    static void OnReadMultipleResponse(const struct ble_msg_attclient_read_multiple_response_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+
+    static ReadAggregatorStats Stats(uint8 connection);
+};
+
+
+#endif  // INC_READAGGREGATOR_H_
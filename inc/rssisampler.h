@@ -0,0 +1,87 @@
+#ifndef INC_RSSISAMPLER_H_
+#define INC_RSSISAMPLER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Samples the RSSI of every connection with ble_cmd_connection_get_rssi and
+ * keeps moving statistics per link: an exponentially weighted mean and mean
+ * deviation (weights 1/8 and 1/4, as for round trip times), plus the range.
+ *
+ * Links take turns, each due once per period. Requests are queued with
+ * AttScheduler in its idle class, which a link serves only when nothing else
+ * is queued on it, and only one at a time while no write stream runs. So
+ * sampling fills the gaps between data procedures and never holds one up; a
+ * link that is busy when due is sampled in its next gap.
+ *
+ * Poll() sends the requests, see steadyclock.h.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+struct RssiStats {
+    uint32 samples;
+    int8 last;              // dBm
+    int8 min;
+    int8 max;
+    float mean;             // moving, dBm
+    float deviation;        // moving mean deviation, dB
+    uint64_t last_ms;       // steady clock of the last sample
+};
+
+
+class RssiSampler {
+    private:
+    struct Link {
+        bool connected;
+        uint64_t due_ms;
+        RssiStats stats;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+    static uint32 period_ms_;
+    static uint8 next_connection_;
+    static int pending_;                // connection asked, -1 if none
+
+
+    public:
+    static void SetPeriod(uint32 milliseconds);
+
+    static void Poll();
+
+    static void OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+    static void OnRssi(uint8 connection, int8 rssi);
+
+    static RssiStats Stats(uint8 connection);
+};
+
+
+#endif  // INC_RSSISAMPLER_H_
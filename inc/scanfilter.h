@@ -0,0 +1,120 @@
+#ifndef INC_SCANFILTER_H_
+#define INC_SCANFILTER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Decides per scan response whether an advertiser is of interest, before
+ * Scanner spends anything on it. A filter is a conjunction of terms; terms
+ * that list several values (services, manufacturers, names) match any one.
+ *
+ * Compile() turns the terms into a short program. Terms on fields of the
+ * event itself (RSSI, address) come first, so most advertisers are rejected
+ * after a compare or two; terms on the advertising data are checked in a
+ * single walk over the AD structures that stops once all are satisfied.
+ * 16-bit service UUIDs are looked up in a bit set, others in sorted tables;
+ * UUIDs built on the Bluetooth base UUID are reduced to their short form on
+ * both sides, so either form matches.
+ *
+ * An advertiser may split its data between the advertisement and the scan
+ * response, e.g. the service in one and the name in the other. MatchData()
+ * takes both payloads and lets each term be satisfied by either; Scanner
+ * keeps the latest of each for advertisers the filter has not passed yet.
+ *
+ * A compiled filter is immutable, Match() may run on any thread.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+
+
+class ScanFilter {
+    private:
+    enum Op {
+        kOpMinRssi,
+        kOpAddressPrefix
+    };
+
+    // which advertising data terms are asked for, and satisfied
+    enum AdTerm {
+        kTermService = 1,
+        kTermName = 2,
+        kTermManufacturer = 4
+    };
+
+    struct Instruction {
+        uint8 op;           // Op
+        int8 rssi;
+        uint8 len;
+        uint8 bytes[6];     // address prefix, in bd_addr order
+    };
+
+    struct Uuid128 {
+        uint8 bytes[16];
+        bool operator<(const Uuid128& other) const;
+    };
+
+    // terms as given
+    bool has_rssi_;
+    int8 min_rssi_;
+    std::vector<uint8> address_prefix_;
+    std::vector<std::vector<uint8> > services_;
+    std::vector<std::string> names_;
+    std::vector<uint16> manufacturers_;
+
+    // compiled
+    std::vector<Instruction> program_;  // terms on fields of the event
+    uint8 ad_terms_;                    // checked after the program
+    std::vector<uint64_t> uuid16_;      // bit set of 65536
+    std::vector<uint32> uuid32_;        // sorted
+    std::vector<Uuid128> uuid128_;      // sorted
+
+    static bool Shorten(const uint8* uuid, uint8 len, uint32* out);
+    bool MatchUuid(const uint8* uuid, uint8 len) const;
+    uint8 SatisfyAdvertisingData(const uint8* data, uint8 len, uint8 satisfied) const;
+
+    public:
+    ScanFilter();
+
+    ScanFilter& MinRssi(int8 dbm);
+    ScanFilter& AddressPrefix(const uint8* prefix, uint8 len);
+    ScanFilter& Service(const uint8* uuid, uint8 len);
+    ScanFilter& NamePrefix(const std::string& prefix);
+    ScanFilter& Manufacturer(uint16 company);
+
+    void Compile();
+
+    bool Match(const struct ble_msg_gap_scan_response_evt_t* msg) const;
+    bool MatchEvent(const struct ble_msg_gap_scan_response_evt_t* msg) const;
+    bool MatchData(const uint8* data, uint8 len, const uint8* other, uint8 other_len) const;
+};
+
+
+#endif  // INC_SCANFILTER_H_
@@ -0,0 +1,152 @@
+#ifndef INC_SCANNER_H_
+#define INC_SCANNER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Scans with ble_cmd_gap_discover and keeps one entry per advertiser: when it
+ * was first and last seen, how often, RSSI statistics and its latest
+ * advertising or scan response payload.
+ *
+ * The table is allocated once by Init() and uses open addressing with linear
+ * probing, keyed by address and address type, so an advertisement costs a
+ * hash and a few compares and never allocates. Entries are not removed while
+ * scanning; once the table is 7/8 full new advertisers are counted and
+ * ignored. An optional ScanFilter rejects advertisers before they get
+ * that far. Its advertising data terms are checked against the latest
+ * advertisement and scan response together, which a small direct mapped
+ * cache keeps for advertisers that have not passed on one payload alone.
+ *
+ * Start() and Stop() queue their commands with AttScheduler, which sends
+ * them one at a time, each after the response to the previous one.
+ *
+ * OnScanResponse() runs on the thread of ReadBleMessage(). Find() and
+ * Snapshot() may run on any thread at the same time: every entry carries a
+ * sequence lock, readers retry while the entry is being written.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./scanfilter.h"
+
+
+/* What is known about one advertiser */
+struct ScanDevice {
+    bd_addr address;
+    uint8 address_type;
+    uint8 packet_type;      // of the latest payload
+    bool scannable;         // advertises in a way that answers scan requests
+    bool scan_response;     // a scan response has been received
+    uint64_t first_seen_us; // steady clock
+    uint64_t last_seen_us;
+    uint32 count;
+    int8 rssi;              // latest
+    int8 rssi_min;
+    int8 rssi_max;
+    int64_t rssi_sum;       // mean is rssi_sum / count
+    uint8 data_len;
+    uint8 data[31];         // latest advertising or scan response data
+};
+
+/* ble_evt_gap_scan_response packet types */
+enum ScanPacketType {
+    kScanConnectable = 0,
+    kScanNonConnectable = 2,
+    kScanResponse = 4,
+    kScanDiscoverable = 6
+};
+
+struct ScannerStats {
+    uint64_t advertisements;
+    uint32 devices;
+    uint32 capacity;
+    uint64_t filtered;      // advertisements the filter rejected
+    uint64_t table_full;    // advertisements of devices that did not fit
+    uint64_t probes;        // slots looked at, probes / advertisements ~ 1
+};
+
+
+class Scanner {
+    private:
+    struct Slot {
+        std::atomic<uint32> seq;    // odd while being written
+        std::atomic<bool> used;
+        ScanDevice device;
+    };
+
+    static std::unique_ptr<Slot[]> slots_;
+    static size_t mask_;
+    static int bits_;                   // log2 of the table size
+    static std::atomic<uint32> devices_;
+    static ScannerStats stats_;
+    static std::unique_ptr<ScanFilter> filter_;
+
+    // the two payloads of an advertiser the filter has not passed on one
+    struct Halves {
+        bd_addr address;
+        uint8 address_type;
+        uint8 advertisement_len;    // 0 until received
+        uint8 response_len;
+        uint8 advertisement[31];
+        uint8 response[31];
+    };
+
+    static const int kHalvesBits = 8;
+    static const size_t kHalves = 1 << kHalvesBits;
+    static Halves halves_[kHalves];
+
+    static size_t Hash(const bd_addr& address, uint8 address_type, int bits);
+    static bool Admit(const struct ble_msg_gap_scan_response_evt_t* msg);
+    static bool Read(const Slot& slot, ScanDevice* out);
+
+    public:
+    static const size_t kDefaultCapacity = 16384;
+
+    static void Init(size_t capacity);
+    static void Clear();
+
+    static void SetFilter(const ScanFilter& filter);
+    static void ClearFilter();
+
+    static void Start(uint16 interval, uint16 window, bool active);
+    static void Stop();
+
+    static void OnScanResponse(const struct ble_msg_gap_scan_response_evt_t* msg);
+
+    static bool Find(const bd_addr& address, uint8 address_type, ScanDevice* out);
+    static size_t Snapshot(std::vector<ScanDevice>* out);
+
+    static ScannerStats Stats();
+};
+
+
+#endif  // INC_SCANNER_H_
@@ -0,0 +1,124 @@
+#ifndef INC_SCANSCHEDULER_H_
+#define INC_SCANSCHEDULER_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Tunes Scanner's interval, window and mode while it runs. Every period it
+ * looks at what the scanner has seen:
+ *
+ *  - The advertising interval of the slowest advertisers (90th percentile),
+ *    estimated from how often each was received during the last period at
+ *    the duty cycle of that period.
+ *    A duty cycle d hears an advertisement with probability about d, so the
+ *    chance of missing an advertiser for the target latency L is
+ *    (1 - d)^(L / T). The scheduler picks the smallest d that keeps this
+ *    below 5%, never lowering it while new devices keep turning up.
+ *  - Our own connections. While any is up the duty cycle is capped and the
+ *    interval shortened, so scan windows fit between connection events
+ *    instead of crowding them out.
+ *  - Scannable devices without scan response data. Scanning is passive;
+ *    when enough new ones pile up a short active burst asks for their scan
+ *    responses, then scanning goes passive again.
+ *
+ * Poll() ends bursts and re-plans, see steadyclock.h.
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <unordered_map>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* Scan parameters in units of 625us, as ble_cmd_gap_set_scan_parameters */
+struct ScanSchedule {
+    uint16 interval;
+    uint16 window;
+    bool active;
+};
+
+struct ScanSchedulerConfig {
+    uint32 target_latency_ms;   // an advertiser should be seen within this
+    uint32 period_ms;           // how often to re-plan
+    uint32 burst_ms;            // length of an active burst
+    uint32 missing_responses;   // scannable devices without one that start a burst
+    uint8 min_duty;             // percent
+    uint8 connected_duty;       // percent at most while connections are up
+
+    static ScanSchedulerConfig Default();
+};
+
+struct ScanSchedulerStats {
+    uint32 plans;
+    uint32 changes;             // parameter sets sent to the dongle
+    uint32 bursts;
+    uint32 advertising_interval_ms;
+    uint8 duty;                 // percent
+    uint32 devices;
+    uint32 new_devices;         // during the last period
+};
+
+
+class ScanScheduler {
+    private:
+    static ScanSchedulerConfig config_;
+    static ScanSchedule current_;
+    static ScanSchedulerStats stats_;
+    static bool running_;
+    static bool connected_[APP_MAX_CONNECTIONS];
+    static uint64_t next_plan_ms_;
+    static uint64_t burst_end_ms_;
+    static uint32 last_devices_;
+    static uint64_t last_plan_ms_;
+    static uint32 burst_missing_;                   // unanswered after the last burst
+    static std::unordered_map<uint64_t, uint32> last_counts_;  // per address
+
+    static const uint16 kIdleInterval = 320;        // 200ms
+    static const uint16 kConnectedInterval = 96;    // 60ms
+    static const uint16 kMinWindow = 4;             // 2.5ms
+
+    static uint32 Connections();
+    static void Plan(uint64_t now);
+    static void Apply(const ScanSchedule& schedule);
+
+    public:
+    static void Start(const ScanSchedulerConfig& config);
+    static void Stop();
+    static bool IsRunning() { return running_; }
+
+    static void Poll();
+
+    static void OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+
+    static ScanSchedule Current() { return current_; }
+    static ScanSchedulerStats Stats() { return stats_; }
+};
+
+
+#endif  // INC_SCANSCHEDULER_H_
@@ -63,6 +63,8 @@ class SimpleSerial {
     static void WriteBleMessage(uint8 len1, uint8* data1,
                                    uint16 len2, uint8* data2);
 
+    static void WriteRaw(const uint8* data, size_t len);
+
     static int ReadBleMessage();
 };
 
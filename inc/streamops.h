@@ -0,0 +1,164 @@
+#ifndef INC_STREAMOPS_H_
+#define INC_STREAMOPS_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Reduces notification streams as they arrive. A pipeline is set up per
+ * connection and handle: one field of the value is decoded with its
+ * PayloadSchema and passed through a chain of operators, whatever leaves the
+ * last one goes to the sink.
+ *
+ * Operators:
+ *  - decimate: passes every n-th sample
+ *  - change only: passes a sample if it differs from the last one passed by
+ *    more than a dead band
+ *  - tumbling window: one summary (min, max, mean, count) per window, emitted
+ *    by Poll() once the window is over, or by a later sample or Flush()
+ *    before that
+ *  - sliding window: a summary of the samples of the last window for every
+ *    sample, from at most capacity samples
+ *
+ * Summaries are samples too, so operators can be chained in any order. A
+ * window adds up the sums and counts of the raw samples that are new in each
+ * input, not the means, so a window after a sliding one still gets the mean
+ * of the raw samples although the sliding summaries overlap.
+ *
+ * All state is allocated by Configure(), OnValue() does not allocate. A sink
+ * must not configure or remove pipelines. Not thread safe: call everything
+ * from the thread that runs ReadBleMessage().
+ *
+ * Poll() closes the tumbling windows, see steadyclock.h.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./payloadschema.h"
+
+
+/* A raw sample or a summary of several */
+struct StreamSample {
+    uint64_t time_us;       // steady clock; start of the window for summaries
+    double value;           // mean for summaries
+    double min;
+    double max;
+    uint32 count;           // raw samples represented
+    double sum;             // of the raw samples new in this one
+    uint32 fresh;           // raw samples new in this one, count but for sliding windows
+};
+
+enum StreamOpType {
+    kStreamDecimate,
+    kStreamChangeOnly,
+    kStreamTumbling,
+    kStreamSliding
+};
+
+struct StreamOp {
+    uint8 type;             // StreamOpType
+    uint32 factor;          // decimate: n, sliding: capacity in samples
+    double dead_band;       // change only
+    uint64_t window_us;     // tumbling and sliding
+
+    static StreamOp Decimate(uint32 n);
+    static StreamOp ChangeOnly(double dead_band);
+    static StreamOp Tumbling(uint64_t window_us);
+    static StreamOp Sliding(uint64_t window_us, uint32 capacity);
+};
+
+struct StreamStats {
+    uint64_t samples_in;
+    uint64_t samples_out;
+};
+
+typedef std::function<void(uint8 connection, uint16 handle, const StreamSample& sample)> stream_sink;
+
+
+class StreamOperators {
+    private:
+    // fixed size ring of sequence numbers, the monotonic queues of a sliding window
+    struct SeqQueue {
+        std::vector<uint64_t> seq;
+        size_t head;
+        size_t size;
+    };
+
+    struct Stage {
+        StreamOp op;
+        // decimate, change only
+        uint32 seen;
+        bool has_last;
+        double last;
+        // tumbling
+        StreamSample window;
+        // sliding, the last samples and queues of their minima and maxima
+        std::vector<StreamSample> ring;
+        uint64_t next_seq;
+        uint64_t first_seq;
+        double sum;
+        uint64_t count;
+        SeqQueue min_queue;
+        SeqQueue max_queue;
+    };
+
+    struct Pipeline {
+        uint8 connection;
+        uint16 handle;
+        const PayloadSchema* schema;
+        size_t field;
+        std::vector<Stage> stages;
+        stream_sink sink;
+        StreamStats stats;
+    };
+
+    static std::vector<Pipeline> pipelines_;
+
+    static Pipeline* Find(uint8 connection, uint16 handle);
+    static void Run(Pipeline* pipeline, size_t stage, const StreamSample& sample);
+    static void Close(Pipeline* pipeline, size_t stage);
+    static void Slide(Stage* stage, const StreamSample& in, StreamSample* out);
+
+    public:
+    static bool Configure(uint8 connection, uint16 handle, const PayloadSchema* schema,
+                          size_t field, const std::vector<StreamOp>& ops,
+                          const stream_sink& sink);
+    static void Remove(uint8 connection, uint16 handle);
+
+    static void OnValue(uint8 connection, uint16 handle, const uint8* data, uint8 len);
+    static void Poll();
+    static void Flush(uint8 connection);
+    static void OnDisconnected(uint8 connection);
+
+    static StreamStats Stats(uint8 connection, uint16 handle);
+};
+
+
+#endif  // INC_STREAMOPS_H_
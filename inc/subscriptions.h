@@ -0,0 +1,105 @@
+#ifndef INC_SUBSCRIPTIONS_H_
+#define INC_SUBSCRIPTIONS_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Remembers which characteristics of a device should notify or indicate,
+ * keyed by device address, and writes their Client Characteristic
+ * Configuration descriptors. The CCCDs are looked up in the connection's
+ * AttributeDb and all writes are queued at AttScheduler at once with high
+ * priority, so they go out back to back instead of one blocking round trip
+ * each.
+ *
+ * Subscriptions are applied again whenever the device reconnects: right away
+ * on a GATT cache hit, otherwise as soon as Discovery has built the
+ * database.
+ *
+ * Not thread safe: call everything from the thread that runs ReadBleMessage().
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./cmd_def.h"
+#include "./config.h"
+
+
+/* Value written to the CCCD */
+enum SubscriptionMode {
+    kSubscribeNone = 0,
+    kSubscribeNotify = 1,
+    kSubscribeIndicate = 2
+};
+
+/* Gets the first error (0 if none), how many CCCDs were written and how
+ * many characteristics had no CCCD */
+typedef std::function<void(uint16 result, uint32 written, uint32 missing)> subscribe_done;
+
+
+class SubscriptionManager {
+    private:
+    struct Wanted {
+        uint8 uuid[16];
+        uint8 uuid_len;
+        uint8 mode;             // SubscriptionMode
+    };
+
+    struct Link {
+        bool connected;
+        uint64_t address;
+        uint32 outstanding;     // CCCD writes queued at AttScheduler
+        uint32 written;
+        uint32 missing;         // subscriptions without a CCCD
+        uint16 result;
+        subscribe_done done;
+    };
+
+    static std::map<uint64_t, std::vector<Wanted> > wanted_;
+    static Link links_[APP_MAX_CONNECTIONS];
+
+    static const uint16 kResultQueued = 0xFFFF;
+
+    static uint64_t Key(const bd_addr& device);
+    static void Written(uint8 connection, uint16 result);
+
+    public:
+    static void Subscribe(const bd_addr& device, const uint8* uuid, uint8 len, uint8 mode);
+    static void Unsubscribe(const bd_addr& device, const uint8* uuid, uint8 len);
+
+    static bool Apply(uint8 connection, const subscribe_done& done);
+    static bool IsApplying(uint8 connection);
+
+    static void OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+    static void OnDatabaseReady(uint8 connection);
+};
+
+
+#endif  // INC_SUBSCRIPTIONS_H_
@@ -0,0 +1,110 @@
+#ifndef INC_TIMESERIES_H_
+#define INC_TIMESERIES_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Append-only store for notification samples, one series per device and
+ * handle. Samples are encoded as they arrive into two columns:
+ *  - timestamps (microseconds since the epoch) as zigzag varint deltas
+ *  - values of up to 8 bytes as little endian integers, zigzag varint deltas;
+ *    longer or varying values as varint length plus raw bytes
+ *
+ * A full segment is written to its own file, named after device, handle and
+ * a sequence number, and never touched again. Scan() maps the segment files
+ * read-only and decodes them.
+ *
+ * Append() may be called from any thread.
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./apitypes.h"
+#include "./notificationring.h"
+
+
+typedef std::function<void(uint64_t time_us, const uint8* data, uint8 len)> sample_visitor;
+
+struct TimeSeriesStats {
+    uint64_t samples;
+    uint64_t raw_bytes;     // 8 byte timestamp plus value per sample
+    uint64_t stored_bytes;  // segment files written
+    uint32 segments;
+};
+
+
+class TimeSeries {
+    private:
+    typedef std::pair<uint64_t, uint16> SeriesKey;     // address, handle
+
+    struct Series {
+        uint32 next_segment;
+        // the open segment
+        uint32 count;
+        uint8 encoding;
+        uint8 width;
+        uint64_t first_time;
+        uint64_t last_time;
+        uint64_t last_value;
+        std::vector<uint8> times;
+        std::vector<uint8> values;
+    };
+
+    static std::string directory_;
+    static std::map<SeriesKey, Series> series_;
+    static TimeSeriesStats stats_;
+    static int64_t steady_to_wall_us_;
+    static std::mutex mutex_;
+
+    static SeriesKey Key(const bd_addr& device, uint16 handle);
+    static std::string FileName(const SeriesKey& key, uint32 segment);
+    static Series& Open(const SeriesKey& key);
+    static bool Seal(const SeriesKey& key, Series* series);
+
+    public:
+    static const uint32 kSamplesPerSegment = 8192;
+
+    static void SetDirectory(const std::string& directory);
+
+    static void Append(const bd_addr& device, uint16 handle, uint64_t time_us,
+                       const uint8* data, uint8 len);
+    static void Append(const bd_addr& device, const Notification& notification);
+    static bool Flush();
+
+    static uint64_t Scan(const bd_addr& device, uint16 handle, const sample_visitor& visit);
+
+    static TimeSeriesStats Stats();
+};
+
+
+#endif  // INC_TIMESERIES_H_
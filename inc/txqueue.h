@@ -0,0 +1,117 @@
+#ifndef INC_TXQUEUE_H_
+#define INC_TXQUEUE_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * ble_send_message() builds each packet on the caller's stack and hands it to
+ * bglib_output. Pointing bglib_output at TxQueue::Submit copies the packet
+ * into a frame on a lock-free multi-producer/single-consumer queue, so any
+ * thread may issue ble_cmd_* without interleaving bytes on the UART. A single
+ * writer thread drains the queue and writes the frames in batches.
+ *
+ * Frames come from a preallocated pool, a lock-free stack with a version tag
+ * against ABA, so submitting never allocates. When every frame is queued the
+ * producer waits for the writer to return one.
+ *
+ * Queue algorithm: D. Vyukov, "Intrusive MPSC node-based queue".
+ *
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "./apitypes.h"
+
+
+// function doing the actual output, e.g. SimpleSerial::WriteRaw
+typedef void (*tx_sink)(const uint8* data, size_t len);
+
+/* Output counters */
+struct TxQueueStats {
+    uint32 frames;      // frames written
+    uint32 batches;     // calls to the sink
+    uint32 bytes;       // bytes written
+    uint32 dropped;     // frames too large for a TxFrame
+};
+
+
+class TxQueue {
+    private:
+    // header + fixed parameters + one uint8array
+    static const size_t kMaxFrame = 320;
+    // bytes the writer collects before calling the sink
+    static const size_t kMaxBatch = 4096;
+
+    // frames in the pool, more than the dongle can take in one go
+    static const uint32_t kPoolFrames = 256;
+
+    struct TxFrame {
+        std::atomic<TxFrame*> next;
+        std::atomic<uint32_t> next_free;    // pool index + 1, 0 ends the list
+        uint16 len;
+        uint8 data[kMaxFrame];
+    };
+
+    static std::atomic<TxFrame*> head_;     // producers push here
+    static TxFrame* tail_;                  // consumer pops here
+    static TxFrame stub_;
+
+    static TxFrame pool_[kPoolFrames];
+    static std::atomic<uint64_t> free_;     // version << 32 | pool index + 1
+    static std::atomic<bool> pool_ready_;
+
+    static std::atomic<bool> running_;
+    static std::atomic<bool> writer_idle_;
+    static std::atomic<uint32> frames_;
+    static std::atomic<uint32> batches_;
+    static std::atomic<uint32> bytes_;
+    static std::atomic<uint32> dropped_;
+    static std::atomic<uint32> pending_;
+    static tx_sink sink_;
+
+    static void InitPool();
+    static TxFrame* Allocate();
+    static void Release(TxFrame* frame);
+
+    static void Push(TxFrame* frame);
+    static TxFrame* Pop();
+    static size_t Drain();
+    static void WriterLoop();
+    static void WakeWriter();
+
+    public:
+    static void Start(tx_sink sink);
+    static void Stop();
+    static void Flush();
+
+    static void Submit(uint8 len1, uint8* data1, uint16 len2, uint8* data2);
+
+    static TxQueueStats Stats();
+};
+
+
+#endif  // INC_TXQUEUE_H_
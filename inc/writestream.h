@@ -0,0 +1,113 @@
+#ifndef INC_WRITESTREAM_H_
+#define INC_WRITESTREAM_H_
+
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * Pushes a byte stream to a characteristic with attclient_write_command
+ * (write without response), 20 bytes per packet.
+ *
+ * The dongle buffers packets until they went out over the air, which it
+ * reports with procedure_completed. The stream keeps a window of packets the
+ * dongle holds and grows it by one packet per window of confirmations
+ * (additive increase). When write_command is refused for lack of buffers the
+ * window is halved (multiplicative decrease) and the packet is sent again
+ * after the next confirmation, or after kRetryMs from Poll() when the dongle
+ * holds none of our packets.
+ * Packets are handed to the dongle one command at a time so they stay in
+ * order.
+ *
+ * Not thread safe: call everything from the thread that runs ReadBleMessage().
+ *
+ */
+
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "./apitypes.h"
+#include "./chainbuffer.h"
+#include "./cmd_def.h"
+#include "./config.h"
+#include "./longattribute.h"
+
+
+/* What a stream achieved */
+struct WriteStreamStats {
+    uint64_t bytes;
+    uint32 packets;
+    uint32 retries;         // packets refused by the dongle and sent again
+    uint32 window_cuts;
+    uint32 max_window;
+    double seconds;
+    double bytes_per_second;
+};
+
+typedef std::function<void(uint16 result, const WriteStreamStats& stats)> stream_done;
+
+
+class WriteStream {
+    private:
+    struct Link {
+        bool active;
+        bool sending;           // a write_command is waiting for its response
+        bool backoff;           // refused, wait for a confirmation before resending
+        uint64_t retry_ns;      // refused with nothing buffered, resend from Poll() after this
+        uint16 handle;
+        chain_buffer_ptr data;
+        uint32 offset;          // first byte not yet accepted by the dongle
+        uint32 unconfirmed;     // accepted packets not yet sent over the air
+        double window;
+        uint64_t start_ns;
+        WriteStreamStats stats;
+        stream_done done;
+    };
+
+    static Link links_[APP_MAX_CONNECTIONS];
+
+    static void Pump(uint8 connection);
+    static void Sent(uint8 connection, uint8 len, uint16 result);
+    static void Finish(uint8 connection, uint16 result);
+
+    public:
+    // ATT_MTU 23 less opcode and handle
+    static const uint8 kPacketSize = 20;
+    static const uint32 kMaxWindow = 32;
+    // pause before a packet refused with nothing of ours buffered is resent
+    static const uint32 kRetryMs = 10;
+    // BGAPI "Out Of Memory" and "Flow", the dongle has no buffer left
+    static const uint16 kResultOutOfMemory = 0x0182;
+    static const uint16 kResultFlow = 0x0187;
+
+    static bool Start(uint8 connection, uint16 handle, const chain_buffer_ptr& data,
+                      const stream_done& done);
+    static bool IsRunning(uint8 connection);
+    static void Poll();
+
+    static bool OnProcedureCompleted(const struct ble_msg_attclient_procedure_completed_evt_t* msg);
+    static void OnDisconnected(uint8 connection);
+};
+
+
+#endif  // INC_WRITESTREAM_H_
@@ -0,0 +1,225 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <string.h>
+
+#include "../inc/advertisingdata.h"
+
+
+AdIterator::AdIterator(const uint8* data, uint8 len)
+    : pos_(data), end_(data + len), malformed_(false) {
+}
+
+
+/**
+ * @brief steps to the next AD structure
+ * @return  false at the end of the data
+ */
+bool AdIterator::Next(AdStructure* out) {
+    if (pos_ >= end_ || !pos_[0]) {
+        pos_ = end_;
+        return false;
+    }
+    uint8 len = pos_[0];
+    if (len > end_ - pos_ - 1) {
+        malformed_ = true;
+        pos_ = end_;
+        return false;
+    }
+    out->type = pos_[1];
+    out->len = len - 1;
+    out->data = pos_ + 2;
+    pos_ += len + 1;
+    return true;
+}
+
+
+AdUuidIterator::AdUuidIterator(const uint8* data, uint8 len)
+    : structures_(data, len), width_(0), offset_(0) {
+    current_.len = 0;
+}
+
+
+/**
+ * @brief steps to the next service UUID, little endian like on air
+ * @return  false when all lists are done
+ */
+bool AdUuidIterator::Next(const uint8** uuid, uint8* len) {
+    while (!width_ || offset_ + width_ > current_.len) {
+        if (!structures_.Next(&current_)) {
+            return false;
+        }
+        switch (current_.type) {
+        case kAdIncompleteUuid16:
+        case kAdCompleteUuid16:
+            width_ = 2;
+            break;
+        case kAdIncompleteUuid32:
+        case kAdCompleteUuid32:
+            width_ = 4;
+            break;
+        case kAdIncompleteUuid128:
+        case kAdCompleteUuid128:
+            width_ = 16;
+            break;
+        default:
+            width_ = 0;
+            break;
+        }
+        offset_ = 0;
+    }
+    *uuid = current_.data + offset_;
+    *len = width_;
+    offset_ += width_;
+    return true;
+}
+
+
+/**
+ * @brief finds the first structure of a type
+ */
+bool AdvertisingData::Find(uint8 type, AdStructure* out) const {
+    AdIterator it(data_, len_);
+    while (it.Next(out)) {
+        if (out->type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @return  true if a structure runs past the end of the data
+ */
+bool AdvertisingData::Malformed() const {
+    AdIterator it(data_, len_);
+    AdStructure s;
+    while (it.Next(&s)) {
+    }
+    return it.Malformed();
+}
+
+
+bool AdvertisingData::Flags(uint8* flags) const {
+    AdStructure s;
+    if (!Find(kAdFlags, &s) || s.len < 1) {
+        return false;
+    }
+    *flags = s.data[0];
+    return true;
+}
+
+
+bool AdvertisingData::TxPower(int8* dbm) const {
+    AdStructure s;
+    if (!Find(kAdTxPower, &s) || s.len < 1) {
+        return false;
+    }
+    *dbm = static_cast<int8>(s.data[0]);
+    return true;
+}
+
+
+/**
+ * @brief complete or shortened local name, not NUL terminated
+ */
+bool AdvertisingData::LocalName(const char** name, uint8* len, bool* complete) const {
+    AdIterator it(data_, len_);
+    AdStructure s;
+    bool found = false;
+    while (it.Next(&s)) {
+        if (s.type == kAdCompleteName || (s.type == kAdShortName && !found)) {
+            *name = reinterpret_cast<const char*>(s.data);
+            *len = s.len;
+            *complete = s.type == kAdCompleteName;
+            found = true;
+            if (*complete) {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+
+/**
+ * @param company   Bluetooth SIG company identifier
+ * @param data      what follows the identifier
+ */
+bool AdvertisingData::ManufacturerData(uint16* company, const uint8** data, uint8* len) const {
+    AdStructure s;
+    if (!Find(kAdManufacturerData, &s) || s.len < 2) {
+        return false;
+    }
+    *company = s.data[0] | (s.data[1] << 8);
+    *data = s.data + 2;
+    *len = s.len - 2;
+    return true;
+}
+
+
+/**
+ * @brief service data of a service
+ * @param uuid      service UUID, little endian
+ * @param uuid_len  2, 4 or 16
+ * @param data      what follows the UUID
+ */
+bool AdvertisingData::ServiceData(const uint8* uuid, uint8 uuid_len, const uint8** data,
+                                  uint8* len) const {
+    uint8 type = uuid_len == 2 ? kAdServiceData16
+               : uuid_len == 4 ? kAdServiceData32
+               : uuid_len == 16 ? kAdServiceData128 : 0;
+    if (!type) {
+        return false;
+    }
+    AdIterator it(data_, len_);
+    AdStructure s;
+    while (it.Next(&s)) {
+        if (s.type == type && s.len >= uuid_len && memcmp(s.data, uuid, uuid_len) == 0) {
+            *data = s.data + uuid_len;
+            *len = s.len - uuid_len;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @return  true if a service UUID list names the service
+ */
+bool AdvertisingData::HasService(const uint8* uuid, uint8 uuid_len) const {
+    AdUuidIterator it(data_, len_);
+    const uint8* u;
+    uint8 len;
+    while (it.Next(&u, &len)) {
+        if (len == uuid_len && memcmp(u, uuid, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,337 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+
+#include "../inc/attributedb.h"
+#include "../inc/utils.h"
+
+
+// 00000000-0000-1000-8000-00805F9B34FB, little endian
+static const uint8 kBaseUuid[16] = {
+    0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const uint8 kPrimaryServiceUuid[]     = GATT_PRIMARY_SERVICE_UUID;
+static const uint8 kSecondaryServiceUuid[]   = GATT_SECONDARY_SERVICE_UUID;
+static const uint8 kIncludeUuid[]            = GATT_INLCUDE_DECLARATION_UUID;
+static const uint8 kCharacteristicUuid[]     = GATT_CHARACTERISTIC_DECLARATION_UUID;
+static const uint8 kClientConfigurationUuid[] = GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_UUID;
+
+
+AttributeDb AttributeDb::dbs_[APP_MAX_CONNECTIONS];
+
+
+/**
+ * @brief widens a 16-bit UUID with the base UUID, copies a 128-bit one
+ * @param data  UUID, little endian
+ * @param len   2, 4 or 16
+ */
+Uuid Uuid::FromBytes(const uint8* data, uint8 len) {
+    Uuid uuid;
+    memcpy(uuid.bytes, kBaseUuid, sizeof(uuid.bytes));
+    if (len == 16) {
+        memcpy(uuid.bytes, data, 16);
+    } else if (len == 2 || len == 4) {
+        memcpy(uuid.bytes + 12, data, len);
+    }
+    return uuid;
+}
+
+
+size_t UuidHash::operator()(const Uuid& uuid) const {
+    // FNV-1a
+    uint32 hash = 2166136261u;
+    for (int i = 0; i < 16; i++) {
+        hash = (hash ^ uuid.bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/**
+ * @return  database of a connection, empty until Build() was called
+ */
+AttributeDb* AttributeDb::ForConnection(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return nullptr;
+    }
+    return &dbs_[connection];
+}
+
+
+static bool IsUuid(const GattAttribute& a, const uint8* uuid16) {
+    return a.uuid_len == 2 && a.uuid[0] == uuid16[0] && a.uuid[1] == uuid16[1];
+}
+
+
+/**
+ * @brief (re)builds the database from discovery results
+ * @param attributes    as recorded by GattCache, in any order
+ */
+void AttributeDb::Build(const std::vector<GattAttribute>& attributes) {
+    std::map<uint16, AttEntry> handles;
+    std::map<uint16, uint16> service_ends;
+
+    // what is each handle?
+    for (size_t i = 0; i < attributes.size(); i++) {
+        const GattAttribute& a = attributes[i];
+        Uuid uuid = Uuid::FromBytes(a.uuid, a.uuid_len);
+
+        AttEntry& e = handles[a.handle];
+        e.handle = a.handle;
+
+        switch (a.kind) {
+        case kGattService:
+            e.type = kAttPrimaryService;
+            e.uuid = uuid;
+            service_ends[a.handle] = a.end;
+            break;
+        case kGattCharacteristic: {
+            e.type = kAttCharacteristicDeclaration;
+            e.uuid = uuid;
+            e.value = a.end;
+            e.properties = a.properties;
+
+            AttEntry& v = handles[a.end];
+            v.handle = a.end;
+            v.type = kAttCharacteristicValue;
+            v.uuid = uuid;
+            break;
+        }
+        case kGattAttribute:
+            if (IsUuid(a, kPrimaryServiceUuid)) {
+                e.type = kAttPrimaryService;
+            } else if (IsUuid(a, kSecondaryServiceUuid)) {
+                e.type = kAttSecondaryService;
+            } else if (IsUuid(a, kIncludeUuid)) {
+                e.type = kAttInclude;
+            } else if (IsUuid(a, kCharacteristicUuid)) {
+                e.type = kAttCharacteristicDeclaration;
+            } else {
+                // value or descriptor, decided below; a characteristic value
+                // found by read_by_type already carries the right UUID
+                if (e.type != kAttCharacteristicValue) {
+                    e.type = kAttDescriptor;
+                }
+                e.uuid = uuid;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    Clear();
+    entries_.reserve(handles.size());
+    for (std::map<uint16, AttEntry>::iterator it = handles.begin();
+         it != handles.end(); ++it) {
+        entries_.push_back(it->second);
+    }
+
+    // one pass in handle order: services own everything up to the next
+    // service, characteristics everything up to the next declaration
+    Uuid cccd = Uuid::FromBytes(kClientConfigurationUuid, 2);
+    int service = -1;
+    int declaration = -1;
+
+    for (size_t i = 0; i < entries_.size(); i++) {
+        AttEntry& e = entries_[i];
+
+        if (e.type == kAttPrimaryService || e.type == kAttSecondaryService) {
+            service = i;
+            declaration = -1;
+            std::map<uint16, uint16>::const_iterator end = service_ends.find(e.handle);
+            e.service_end = end != service_ends.end() ? end->second : 0xFFFF;
+        }
+        if (service >= 0) {
+            e.service = entries_[service].handle;
+            e.service_end = entries_[service].service_end;
+        }
+
+        if (e.type == kAttCharacteristicDeclaration) {
+            declaration = i;
+            e.declaration = e.handle;
+            if (!e.value) {
+                // without the declaration's value the value handle follows it
+                e.value = e.handle + 1;
+            }
+            continue;
+        }
+        if (declaration < 0 || e.type == kAttInclude
+                || e.type == kAttPrimaryService || e.type == kAttSecondaryService) {
+            continue;
+        }
+
+        AttEntry& decl = entries_[declaration];
+        e.declaration = decl.handle;
+        e.value = decl.value;
+
+        if (e.handle == decl.value) {
+            e.type = kAttCharacteristicValue;
+            e.properties = decl.properties;
+            decl.uuid = e.uuid;
+        } else if (e.uuid == cccd) {
+            decl.cccd = e.handle;
+        }
+    }
+
+    // hand value handle, CCCD and properties to the value entries
+    for (size_t i = 0; i < entries_.size(); i++) {
+        AttEntry& e = entries_[i];
+        if (e.type != kAttCharacteristicValue && e.type != kAttDescriptor) {
+            continue;
+        }
+        const AttEntry* decl = FindByHandle(e.declaration);
+        if (decl) {
+            e.cccd = decl->cccd;
+            e.properties = decl->properties;
+        }
+    }
+
+    for (uint32 i = 0; i < entries_.size(); i++) {
+        by_uuid_[entries_[i].uuid].push_back(i);
+    }
+}
+
+
+/**
+ * @brief forgets all attributes, e.g. after a disconnect
+ */
+void AttributeDb::Clear() {
+    entries_.clear();
+    by_uuid_.clear();
+}
+
+
+/**
+ * @return  attribute with the given handle or nullptr
+ */
+const AttEntry* AttributeDb::FindByHandle(uint16 handle) const {
+    std::vector<AttEntry>::const_iterator it = std::lower_bound(
+                entries_.begin(), entries_.end(), handle,
+                [](const AttEntry& e, uint16 h) { return e.handle < h; });
+    if (it == entries_.end() || it->handle != handle) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+
+/**
+ * @return  all attributes with the given UUID
+ */
+std::vector<const AttEntry*> AttributeDb::FindAll(const uint8* uuid, uint8 len) const {
+    std::vector<const AttEntry*> found;
+    std::unordered_map<Uuid, std::vector<uint32>, UuidHash>::const_iterator it =
+            by_uuid_.find(Uuid::FromBytes(uuid, len));
+    if (it != by_uuid_.end()) {
+        for (size_t i = 0; i < it->second.size(); i++) {
+            found.push_back(&entries_[it->second[i]]);
+        }
+    }
+    return found;
+}
+
+
+/**
+ * @return  declaration of the first service with the given UUID or nullptr
+ */
+const AttEntry* AttributeDb::FindService(const uint8* uuid, uint8 len) const {
+    std::unordered_map<Uuid, std::vector<uint32>, UuidHash>::const_iterator it =
+            by_uuid_.find(Uuid::FromBytes(uuid, len));
+    if (it == by_uuid_.end()) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < it->second.size(); i++) {
+        const AttEntry& e = entries_[it->second[i]];
+        if (e.type == kAttPrimaryService || e.type == kAttSecondaryService) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+ * @return  value attribute of the first characteristic with the given UUID
+ *          or nullptr
+ */
+const AttEntry* AttributeDb::FindCharacteristic(const uint8* uuid, uint8 len) const {
+    std::unordered_map<Uuid, std::vector<uint32>, UuidHash>::const_iterator it =
+            by_uuid_.find(Uuid::FromBytes(uuid, len));
+    if (it == by_uuid_.end()) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < it->second.size(); i++) {
+        const AttEntry& e = entries_[it->second[i]];
+        if (e.type == kAttCharacteristicValue) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+ * @return  value handle of a characteristic, 0 if unknown
+ */
+uint16 AttributeDb::ValueHandle(const uint8* uuid, uint8 len) const {
+    const AttEntry* e = FindCharacteristic(uuid, len);
+    return e ? e->handle : 0;
+}
+
+
+/**
+ * @return  CCCD handle of a characteristic, 0 if unknown or none
+ */
+uint16 AttributeDb::CccdHandle(const uint8* uuid, uint8 len) const {
+    const AttEntry* e = FindCharacteristic(uuid, len);
+    return e ? e->cccd : 0;
+}
+
+
+/**
+ * @brief dumps the database to stdout
+ */
+void AttributeDb::Print() const {
+    static const char* kTypes[] = {
+        "service", "service (2nd)", "include", "characteristic", "value", "descriptor"
+    };
+
+    for (size_t i = 0; i < entries_.size(); i++) {
+        const AttEntry& e = entries_[i];
+        printf("\t0x%04x %-14s ", e.handle, kTypes[e.type]);
+        printUUID(const_cast<uint8*>(e.uuid.bytes), 16);
+        if (e.type == kAttCharacteristicValue && e.cccd) {
+            printf(" cccd 0x%04x", e.cccd);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,391 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <cstddef>
+#include <utility>
+
+#include "../inc/attscheduler.h"
+
+
+// weighted round robin: per refill a class may issue this many operations,
+// the idle class takes no part
+static const uint8 kClassWeight[kAttPriorityCount] = { 4, 2, 1, 0 };
+
+
+AttScheduler::Link AttScheduler::links_[APP_MAX_CONNECTIONS];
+std::deque<AttOp> AttScheduler::commands_;
+AttOp AttScheduler::command_in_flight_;
+bool AttScheduler::command_pending_    = false;
+int AttScheduler::command_connection_  = -1;
+uint8 AttScheduler::next_connection_   = 0;
+
+
+/**
+ * @brief queues a GATT operation for a connection and tries to issue it
+ * @param connection    connection handle the operation belongs to
+ * @param op            the operation, see AttOp; fails right away with
+ *                      kResultNotConnected if the link is down
+ */
+void AttScheduler::Submit(uint8 connection, const AttOp& op) {
+    // a link that is down would keep the operation for whichever device
+    // gets its handle next
+    if (connection >= APP_MAX_CONNECTIONS || !links_[connection].connected) {
+        if (op.done) {
+            op.done(kResultNotConnected);
+        }
+        return;
+    }
+
+    Link& link = links_[connection];
+    link.queue[op.priority].push_back(op);
+    link.stats.queued++;
+
+    Pump();
+}
+
+
+/**
+ * @brief queues a command that is not part of a link's procedures, e.g.
+ *        ble_cmd_gap_discover; it completes with its response
+ * @param op    the command, priority and completion are not used; issue is
+ *              called with connection 0xFF
+ */
+void AttScheduler::SubmitCommand(const AttOp& op) {
+    commands_.push_back(op);
+    Pump();
+}
+
+
+/**
+ * @brief issues the next operation, if the command slot is free
+ *
+ * Commands go first. Connections are visited round robin starting behind
+ * the one that issued last, so a link with a deep queue cannot starve the
+ * others.
+ */
+void AttScheduler::Pump() {
+    if (command_pending_) {
+        return;
+    }
+
+    if (!commands_.empty()) {
+        command_in_flight_ = std::move(commands_.front());
+        commands_.pop_front();
+        command_pending_ = true;
+        command_connection_ = kLocalCommand;
+        command_in_flight_.issue(0xFF);
+        return;
+    }
+
+    for (uint8 i = 0; i < APP_MAX_CONNECTIONS; i++) {
+        uint8 connection = (next_connection_ + i) % APP_MAX_CONNECTIONS;
+        Link& link = links_[connection];
+
+        if (!link.connected || link.busy) {
+            continue;
+        }
+
+        AttOp op;
+        if (!PopNext(&link, &op)) {
+            continue;
+        }
+
+        link.busy = true;
+        link.in_flight = op;
+        link.stats.issued++;
+        if (op.priority != kAttPriorityIdle && !op.upkeep) {
+            link.stats.data_issued++;
+        }
+
+        command_pending_ = true;
+        command_connection_ = connection;
+        next_connection_ = (connection + 1) % APP_MAX_CONNECTIONS;
+
+        link.in_flight.issue(connection);
+        return;
+    }
+}
+
+
+/**
+ * @brief takes the next operation of a link by weighted round robin over the
+ *        priority classes, the idle class only when the others are empty
+ * @return  false if the link has nothing queued
+ */
+bool AttScheduler::PopNext(Link* link, AttOp* op) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (int prio = 0; prio < kAttPriorityIdle; prio++) {
+            if (link->queue[prio].empty() || link->credit[prio] == 0) {
+                continue;
+            }
+            link->credit[prio]--;
+            *op = std::move(link->queue[prio].front());
+            link->queue[prio].pop_front();
+            return true;
+        }
+
+        // all classes with work have used up their share, start a new round
+        for (int prio = 0; prio < kAttPriorityIdle; prio++) {
+            link->credit[prio] = kClassWeight[prio];
+        }
+    }
+
+    std::deque<AttOp>& idle = link->queue[kAttPriorityIdle];
+    if (idle.empty()) {
+        return false;
+    }
+    *op = std::move(idle.front());
+    idle.pop_front();
+    return true;
+}
+
+
+/**
+ * @brief completes the in-flight operation of a link and issues the next one
+ */
+void AttScheduler::Finish(uint8 connection, uint16 result) {
+    Link& link = links_[connection];
+    if (!link.busy) {
+        return;
+    }
+
+    AttOp op = std::move(link.in_flight);
+    link.in_flight = AttOp();
+    link.busy = false;
+
+    if (result == 0) {
+        link.stats.completed++;
+    } else {
+        link.stats.failed++;
+    }
+
+    if (op.done) {
+        op.done(result);
+    }
+
+    Pump();
+}
+
+
+/**
+ * @brief marks a connection as usable, queued operations start right away
+ */
+void AttScheduler::OnConnected(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    links_[connection].connected = true;
+    Pump();
+}
+
+
+/**
+ * @brief fails everything that is pending on a connection which went away
+ */
+void AttScheduler::OnDisconnected(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+
+    // before any callback runs, so what they submit is refused
+    Link& link = links_[connection];
+    link.connected = false;
+
+    // an operation in flight fails now, but the dongle still owes the
+    // response to its command: the slot stays taken until OnResponse()
+
+    std::deque<AttOp> dropped;
+    for (int prio = 0; prio < kAttPriorityCount; prio++) {
+        for (size_t i = 0; i < link.queue[prio].size(); i++) {
+            dropped.push_back(std::move(link.queue[prio][i]));
+        }
+        link.queue[prio].clear();
+    }
+
+    Finish(connection, kResultNotConnected);
+
+    for (size_t i = 0; i < dropped.size(); i++) {
+        link.stats.failed++;
+        if (dropped[i].done) {
+            dropped[i].done(kResultNotConnected);
+        }
+    }
+}
+
+
+/**
+ * @brief to be called for every ble_rsp_attclient_* response
+ * @param connection    connection handle from the response
+ * @param result        result code from the response
+ */
+void AttScheduler::OnResponse(uint8 connection, uint16 result) {
+    // not ours, e.g. a command sent directly by the application
+    if (!command_pending_ || command_connection_ != connection) {
+        return;
+    }
+
+    command_pending_ = false;
+    command_connection_ = -1;
+
+    const Link& link = links_[connection];
+    if (!link.busy) {
+        // failed already by OnDisconnected()
+        Pump();
+        return;
+    }
+    if (result != 0 || link.in_flight.completion == kAttCompletesOnResponse) {
+        // a failed command never starts a procedure
+        Finish(connection, result);
+        return;
+    }
+
+    Pump();
+}
+
+
+/**
+ * @brief to be called for the response of every command SubmitCommand()
+ *        may have issued
+ * @return  true if it was the response to such a command, it must not be
+ *          taken for one the application waits for
+ */
+bool AttScheduler::OnCommandResponse(uint16 result) {
+    if (!command_pending_ || command_connection_ != kLocalCommand) {
+        return false;
+    }
+
+    command_pending_ = false;
+    command_connection_ = -1;
+
+    AttOp op = std::move(command_in_flight_);
+    command_in_flight_ = AttOp();
+    if (op.done) {
+        op.done(result);
+    }
+
+    Pump();
+    return true;
+}
+
+
+/**
+ * @brief to be called for every ble_evt_attclient_procedure_completed
+ * @return  true if it ended an operation issued here, the application must
+ *          not take it for one of its own procedures
+ */
+bool AttScheduler::OnProcedureCompleted(uint8 connection, uint16 result) {
+    if (connection >= APP_MAX_CONNECTIONS || command_connection_ == connection
+            || !links_[connection].busy) {
+        return false;
+    }
+    Finish(connection, result);
+    return true;
+}
+
+
+/**
+ * @brief to be called for every ble_evt_attclient_attribute_value
+ *
+ * A successful read by handle ends with the value, there is no
+ * procedure_completed event for it.
+ */
+void AttScheduler::OnAttributeValue(uint8 connection, uint8 type) {
+    if (connection >= APP_MAX_CONNECTIONS || command_connection_ == connection) {
+        return;
+    }
+
+    const Link& link = links_[connection];
+    if (link.busy && link.in_flight.completion == kAttCompletesOnValue
+            && type == ATTCLIENT_ATTRIBUTE_VALUE_TYPE_READ) {
+        Finish(connection, 0);
+    }
+}
+
+
+/**
+ * @brief to be called for every ble_evt_attclient_read_multiple_response,
+ *        like a read by handle a successful read_multiple ends with it
+ */
+void AttScheduler::OnReadMultipleResponse(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS || command_connection_ == connection) {
+        return;
+    }
+
+    const Link& link = links_[connection];
+    if (link.busy && link.in_flight.completion == kAttCompletesOnReadMultiple) {
+        Finish(connection, 0);
+    }
+}
+
+
+/**
+ * @return  true if nothing is in flight and nothing is waiting to be issued
+ */
+bool AttScheduler::IsIdle() {
+    if (command_pending_ || !commands_.empty()) {
+        return false;
+    }
+    for (uint8 c = 0; c < APP_MAX_CONNECTIONS; c++) {
+        if (links_[c].busy || (links_[c].connected && QueueDepth(c))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @return  true if a procedure is running on the connection
+ */
+bool AttScheduler::IsBusy(uint8 connection) {
+    return connection < APP_MAX_CONNECTIONS && links_[connection].busy;
+}
+
+
+/**
+ * @return  number of operations waiting to be issued on the connection
+ */
+uint32 AttScheduler::QueueDepth(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return 0;
+    }
+    uint32 depth = 0;
+    for (int prio = 0; prio < kAttPriorityCount; prio++) {
+        depth += links_[connection].queue[prio].size();
+    }
+    return depth;
+}
+
+
+/**
+ * @return  counters of the connection
+ */
+AttSchedulerStats AttScheduler::Stats(uint8 connection) {
+    AttSchedulerStats stats = AttSchedulerStats();
+    if (connection < APP_MAX_CONNECTIONS) {
+        stats = links_[connection].stats;
+    }
+    return stats;
+}
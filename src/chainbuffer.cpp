@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "../inc/chainbuffer.h"
+
+
+const size_t ChainBuffer::kSegmentSize;
+
+
+ChainBuffer::ChainBuffer() : size_(0) {
+}
+
+
+/**
+ * @brief copies data behind what is stored, adds segments as needed
+ */
+void ChainBuffer::Append(const uint8* data, size_t len) {
+    while (len) {
+        if (size_ == segments_.size() * kSegmentSize) {
+            segments_.push_back(std::unique_ptr<uint8[]>(new uint8[kSegmentSize]));
+        }
+        size_t used = size_ % kSegmentSize;
+        size_t n = std::min(len, kSegmentSize - used);
+        memcpy(segments_.back().get() + used, data, n);
+        size_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+
+/**
+ * @brief empties the buffer and frees its segments
+ */
+void ChainBuffer::Clear() {
+    segments_.clear();
+    size_ = 0;
+}
+
+
+/**
+ * @param index     segment number, < SegmentCount()
+ * @param len       receives the number of bytes used in the segment
+ * @return  start of the segment
+ */
+const uint8* ChainBuffer::Segment(size_t index, size_t* len) const {
+    size_t start = index * kSegmentSize;
+    *len = std::min(kSegmentSize, size_ - start);
+    return segments_[index].get();
+}
+
+
+/**
+ * @brief copies a range into contiguous memory, e.g. for a BGAPI command
+ * @return  number of bytes copied, less than len at the end of the buffer
+ */
+size_t ChainBuffer::CopyOut(size_t offset, uint8* dst, size_t len) const {
+    size_t copied = 0;
+    while (copied < len && offset < size_) {
+        size_t index = offset / kSegmentSize;
+        size_t at = offset % kSegmentSize;
+        size_t n = std::min(std::min(len - copied, kSegmentSize - at), size_ - offset);
+        memcpy(dst + copied, segments_[index].get() + at, n);
+        copied += n;
+        offset += n;
+    }
+    return copied;
+}
@@ -0,0 +1,374 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/channelmap.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+
+
+ChannelMapStats ChannelMapManager::stats_[APP_MAX_CONNECTIONS];
+channel_map_done ChannelMapManager::done_;
+int ChannelMapManager::connection_ = -1;
+ChannelMapManager::Phase ChannelMapManager::phase_ = kPhaseIdle;
+int ChannelMapManager::round_ = 0;
+int ChannelMapManager::group_ = 0;
+bool ChannelMapManager::measuring_ = false;
+uint64_t ChannelMapManager::phase_end_ms_ = 0;
+uint64_t ChannelMapManager::next_counters_ms_ = 0;
+ChannelMapManager::CounterRead ChannelMapManager::counters_pending_ = kCountersNone;
+uint32 ChannelMapManager::window_ms_ = 2000;
+ChannelMapManager::Window ChannelMapManager::window_;
+ChannelMapManager::Window ChannelMapManager::before_;
+uint32 ChannelMapManager::probe_loss_[kRounds][kGroups];
+bool ChannelMapManager::probe_valid_[kRounds][kGroups];
+uint8 ChannelMapManager::original_[5];
+uint8 ChannelMapManager::map_[5];
+
+
+/**
+ * @return  0, 1 or 2 for a data channel overlapping Wi-Fi channel 1, 6 or
+ *          11, -1 for one in between
+ */
+int ChannelMapManager::GroupOf(uint8 channel) {
+    // data channels 0..10 sit at 2404..2424MHz, 11..36 at 2428..2478MHz
+    int mhz = channel <= 10 ? 2404 + 2 * channel : 2428 + 2 * (channel - 11);
+    for (int group = 0; group < kGroups; group++) {
+        int center = 2412 + 25 * group;     // 22MHz wide
+        if (mhz >= center - 11 && mhz <= center + 11) {
+            return group;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * @brief the original map minus the channels of the groups in the mask
+ */
+void ChannelMapManager::MapWithout(int group_mask, uint8* map) {
+    memcpy(map, original_, sizeof(original_));
+    for (uint8 channel = 0; channel < 37; channel++) {
+        int group = GroupOf(channel);
+        if (group >= 0 && (group_mask & (1 << group))) {
+            map[channel / 8] &= ~(1 << (channel % 8));
+        }
+    }
+}
+
+
+/**
+ * @brief queues a map change, the map is copied
+ */
+void ChannelMapManager::Apply(uint8 connection, const uint8* map) {
+    memcpy(map_, map, sizeof(map_));
+
+    uint8 copy[5];
+    memcpy(copy, map, sizeof(copy));
+    AttOp op = AttOp();
+    op.priority = kAttPriorityHigh;
+    op.completion = kAttCompletesOnResponse;
+    op.upkeep = true;
+    op.issue = [copy](uint8 c) {
+        ble_cmd_connection_channel_map_set(c, sizeof(copy), copy);
+    };
+    op.done = [connection](uint16 result) {
+        OnMapSet(connection, result);
+    };
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief time each window takes, after the map change settled
+ */
+void ChannelMapManager::SetWindow(uint32 milliseconds) {
+    window_ms_ = milliseconds ? milliseconds : 1;
+}
+
+
+/**
+ * @brief probes the channels of a connection and applies the map found
+ * @param connection    connection handle
+ * @param done          called when the probe ends, may be empty
+ * @return  false if a probe is running already
+ */
+bool ChannelMapManager::Start(uint8 connection, const channel_map_done& done) {
+    if (phase_ != kPhaseIdle || connection >= APP_MAX_CONNECTIONS) {
+        return false;
+    }
+    connection_ = connection;
+    done_ = done;
+    memset(probe_valid_, 0, sizeof(probe_valid_));
+    phase_ = kPhaseReadMap;
+
+    // the map comes with OnMapRead(), the response has no result code
+    AttOp op = AttOp();
+    op.priority = kAttPriorityHigh;
+    op.completion = kAttCompletesOnResponse;
+    op.upkeep = true;
+    op.issue = [](uint8 c) {
+        ble_cmd_connection_channel_map_get(c);
+    };
+    op.done = [connection](uint16 result) {
+        if (result && phase_ == kPhaseReadMap && connection_ == connection) {
+            Finish(result);
+        }
+    };
+    AttScheduler::Submit(connection, op);
+    return true;
+}
+
+
+bool ChannelMapManager::IsRunning() {
+    return phase_ != kPhaseIdle;
+}
+
+
+void ChannelMapManager::StartWindow(Phase phase, uint64_t now) {
+    phase_ = phase;
+    measuring_ = false;
+    phase_end_ms_ = now + kSettleMs;
+    window_ = Window();
+}
+
+
+void ChannelMapManager::Poll() {
+    if (phase_ == kPhaseIdle || phase_ == kPhaseReadMap || counters_pending_ != kCountersNone) {
+        return;
+    }
+
+    uint64_t now = SteadyClock::Ms();
+    if (!measuring_ && now >= phase_end_ms_) {
+        // what the counters gathered while settling is thrown away
+        measuring_ = true;
+        window_.failed_start = AttScheduler::Stats(connection_).failed;
+        phase_end_ms_ = now + window_ms_;
+        counters_pending_ = kCountersDiscard;
+    } else if (measuring_ && now >= phase_end_ms_) {
+        counters_pending_ = kCountersClose;
+    } else if (now >= next_counters_ms_) {
+        // often enough for the 8 bit counters not to saturate
+        counters_pending_ = kCountersAdd;
+    } else {
+        return;
+    }
+    next_counters_ms_ = now + kCountersMs;
+
+    // the counters come with OnCounters(), the response has no result code
+    AttOp op = AttOp();
+    op.issue = [](uint8) {
+        ble_cmd_system_get_counters();
+    };
+    AttScheduler::SubmitCommand(op);
+}
+
+
+void ChannelMapManager::CloseWindow() {
+    window_.lost += AttScheduler::Stats(connection_).failed - window_.failed_start;
+    uint32 total = window_.good + window_.lost;
+    window_.valid = total >= kMinPackets;
+    window_.loss = total ? window_.lost * 1000 / total : 0;
+}
+
+
+void ChannelMapManager::Next(uint64_t now) {
+    ChannelMapStats& stats = stats_[connection_];
+    uint32 goodput = static_cast<uint32>(static_cast<uint64_t>(window_.bytes) * 1000 / window_ms_);
+
+    if (phase_ == kPhaseBefore) {
+        before_ = window_;
+        stats.loss_before = window_.loss;
+        stats.goodput_before = goodput;
+        round_ = 0;
+        group_ = 0;
+        uint8 map[5];
+        MapWithout(1 << group_, map);
+        Apply(connection_, map);
+        StartWindow(kPhaseProbe, now);
+        return;
+    }
+
+    if (phase_ == kPhaseProbe) {
+        probe_loss_[round_][group_] = window_.loss;
+        probe_valid_[round_][group_] = window_.valid;
+        if (++group_ == kGroups) {
+            group_ = 0;
+            round_++;
+        }
+        uint8 map[5];
+        if (round_ < kRounds) {
+            MapWithout(1 << group_, map);
+            Apply(connection_, map);
+            StartWindow(kPhaseProbe, now);
+            return;
+        }
+
+        // bad in every round, against a conclusive original
+        int bad = 0;
+        uint32 worst_loss = 0;
+        int best = 0;           // the group whose absence helped least
+        for (int g = 0; before_.valid && g < kGroups; g++) {
+            bool persistent = true;
+            uint32 loss = 0;
+            for (int r = 0; r < kRounds; r++) {
+                persistent = persistent && probe_valid_[r][g]
+                             && probe_loss_[r][g] * 4 < before_.loss * 3;
+                loss += probe_loss_[r][g];
+            }
+            if (persistent) {
+                bad |= 1 << g;
+            }
+            if (loss >= worst_loss) {
+                worst_loss = loss;
+                best = g;
+            }
+        }
+        if (bad == (1 << kGroups) - 1) {
+            bad &= ~(1 << best);
+        }
+        printf("[#] Channel groups excluded on connection %d: 0x%x\n", connection_, bad);
+        MapWithout(bad, map);
+        Apply(connection_, map);
+        StartWindow(kPhaseAfter, now);
+        return;
+    }
+
+    // kPhaseAfter
+    stats.loss_after = window_.loss;
+    stats.goodput_after = goodput;
+    stats.reverted = false;
+    bool changed = memcmp(map_, original_, sizeof(map_)) != 0;
+    if (changed && window_.valid && before_.valid
+            && (window_.loss > before_.loss || goodput * 10 < stats.goodput_before * 9)) {
+        stats.reverted = true;
+        Apply(connection_, original_);
+    }
+    Finish(0);
+}
+
+
+void ChannelMapManager::Finish(uint16 result) {
+    ChannelMapStats& stats = stats_[connection_];
+    if (!result) {
+        stats.probes++;
+        memcpy(stats.map, map_, sizeof(stats.map));
+        stats.channels = 0;
+        for (uint8 channel = 0; channel < 37; channel++) {
+            if (map_[channel / 8] & (1 << (channel % 8))) {
+                stats.channels++;
+            }
+        }
+    }
+    phase_ = kPhaseIdle;
+    counters_pending_ = kCountersNone;
+    uint8 connection = connection_;
+    connection_ = -1;
+
+    channel_map_done done;
+    done.swap(done_);
+    if (done) {
+        done(result, stats_[connection]);
+    }
+}
+
+
+void ChannelMapManager::OnDisconnected(uint8 connection) {
+    if (phase_ != kPhaseIdle && connection_ == connection) {
+        Finish(kResultNotConnected);
+    }
+}
+
+
+/**
+ * @brief counts the received value bytes of the probed connection
+ */
+void ChannelMapManager::OnAttributeValue(uint8 connection, uint8 len) {
+    if (measuring_ && connection_ == connection) {
+        window_.bytes += len;
+    }
+}
+
+
+/**
+ * @brief to be called for every ble_rsp_system_get_counters
+ */
+void ChannelMapManager::OnCounters(const struct ble_msg_system_get_counters_rsp_t* msg) {
+    CounterRead read = counters_pending_;
+    counters_pending_ = kCountersNone;
+    if (phase_ == kPhaseIdle || read == kCountersNone || read == kCountersDiscard) {
+        return;
+    }
+    window_.good += msg->txok + msg->rxok;
+    window_.lost += msg->txretry + msg->rxfail;
+    if (read == kCountersClose) {
+        CloseWindow();
+        Next(SteadyClock::Ms());
+    }
+}
+
+
+/**
+ * @brief to be called for every ble_rsp_connection_channel_map_get
+ */
+void ChannelMapManager::OnMapRead(const struct ble_msg_connection_channel_map_get_rsp_t* msg) {
+    if (phase_ != kPhaseReadMap || connection_ != msg->connection) {
+        return;
+    }
+    // all 37 data channels unless told otherwise
+    static const uint8 kAllChannels[5] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x1F };
+    memcpy(original_, kAllChannels, sizeof(original_));
+    if (msg->map.len == sizeof(original_)) {
+        memcpy(original_, msg->map.data, sizeof(original_));
+    }
+    memcpy(map_, original_, sizeof(map_));
+    StartWindow(kPhaseBefore, SteadyClock::Ms());
+}
+
+
+/**
+ * @brief completes a map change Apply() queued
+ */
+void ChannelMapManager::OnMapSet(uint8 connection, uint16 result) {
+    if (!result || phase_ == kPhaseIdle || connection_ != connection) {
+        return;
+    }
+    Finish(result);
+    if (result != kResultNotConnected) {
+        // back to the map that worked before, once the link is free again
+        Apply(connection, original_);
+    }
+}
+
+
+ChannelMapStats ChannelMapManager::Stats(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return ChannelMapStats();
+    }
+    return stats_[connection];
+}
@@ -37,6 +37,7 @@
 #include "../inc/cmd_def.h"
 #include "../inc/config.h"
 #include "../inc/utils.h"
+#include "../inc/hooks.h"
 
 void ble_default(const void*v) {
 }
@@ -50,7 +51,7 @@ void ble_evt_attributes_status(const struct ble_msg_attributes_status_evt_t *msg
 }
 
 void ble_rsp_attclient_indicate_confirm(const struct ble_msg_attclient_indicate_confirm_rsp_t*msg) {
-
+    hook_rsp_attclient_indicate_confirm(msg->result);
 }
 
 void ble_rsp_test_debug(const struct ble_msg_test_debug_rsp_t*msg) {
@@ -62,19 +63,19 @@ void ble_rsp_hardware_set_txpower(const void *nul) {
 }
 
 void ble_rsp_attclient_read_multiple(const struct ble_msg_attclient_read_multiple_rsp_t *msg) {
-
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_evt_attclient_read_multiple_response(const struct ble_msg_attclient_read_multiple_response_evt_t *msg) {
-
+    hook_evt_attclient_read_multiple_response(msg);
 }
 
 void ble_rsp_attclient_prepare_write(const struct ble_msg_attclient_prepare_write_rsp_t *msg) {
-
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_execute_write(const struct ble_msg_attclient_execute_write_rsp_t *msg) {
-
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_evt_attributes_user_read_request(const struct ble_msg_attributes_user_read_request_evt_t *msg) {
@@ -94,7 +95,7 @@ void ble_rsp_system_whitelist_clear(const void *nul) {
 }
 
 void ble_rsp_attclient_write_command(const struct ble_msg_attclient_write_command_rsp_t *msg) {
-
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_reserved(const void *nul) {
@@ -102,11 +103,11 @@ void ble_rsp_attclient_reserved(const void *nul) {
 }
 
 void ble_rsp_attclient_read_long(const struct ble_msg_attclient_read_long_rsp_t *msg) {
-
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_system_whitelist_append(const struct ble_msg_system_whitelist_append_rsp_t *msg) {
-
+    hook_rsp_command(msg->result);
 }
 
 void ble_rsp_sm_set_parameters(const void *nul) {
@@ -194,7 +195,7 @@ void ble_rsp_gap_set_adv_data(const struct ble_msg_gap_set_adv_data_rsp_t *msg)
 }
 
 void ble_rsp_gap_set_scan_parameters(const struct ble_msg_gap_set_scan_parameters_rsp_t *msg) {
-
+    hook_rsp_command(msg->result);
 }
 
 void ble_rsp_gap_set_directed_connectable_mode(const struct ble_msg_gap_set_directed_connectable_mode_rsp_t *msg) {
@@ -218,11 +219,12 @@ void ble_rsp_gap_set_privacy_flags(const void *nul) {
 }
 
 void ble_rsp_gap_connect_selective(const struct ble_msg_gap_connect_selective_rsp_t *msg) {
-
+    printf("[<] ble_rsp_gap_connect_selective, result: 0x%04X\n", msg->result);
+    hook_rsp_command(msg->result);
 }
 
 void ble_rsp_system_whitelist_remove(const struct ble_msg_system_whitelist_remove_rsp_t *msg) {
-
+    hook_rsp_command(msg->result);
 }
 
 void ble_rsp_system_reset(const void* nul) {
@@ -241,6 +243,7 @@ void ble_rsp_system_reg_read(const struct ble_msg_system_reg_read_rsp_t *msg) {
 }
 
 void ble_rsp_system_get_counters(const struct ble_msg_system_get_counters_rsp_t *msg) {
+    hook_rsp_system_get_counters(msg);
 }
 
 void ble_rsp_system_get_connections(const struct ble_msg_system_get_connections_rsp_t *msg) {
@@ -290,6 +293,9 @@ void ble_rsp_attributes_read_type(const struct ble_msg_attributes_read_type_rsp_
 
 void ble_rsp_connection_disconnect(const struct ble_msg_connection_disconnect_rsp_t *msg) {
     printf("[<] ble_rsp_connection_disconnect\n");
+    if (hook_rsp_command(msg->result)) {
+        return;
+    }
     if (msg->result == 0) {
         clearFlag(app_state, APP_COMMAND_PENDING);
     } else {
@@ -298,18 +304,22 @@ void ble_rsp_connection_disconnect(const struct ble_msg_connection_disconnect_rs
 }
 
 void ble_rsp_connection_get_rssi(const struct ble_msg_connection_get_rssi_rsp_t *msg) {
+    hook_rsp_connection_get_rssi(msg->connection, msg->rssi);
 }
 
 void ble_rsp_connection_update(const struct ble_msg_connection_update_rsp_t *msg) {
+    hook_rsp_connection(msg->connection, msg->result);
 }
 
 void ble_rsp_connection_version_update(const struct ble_msg_connection_version_update_rsp_t *msg) {
 }
 
 void ble_rsp_connection_channel_map_get(const struct ble_msg_connection_channel_map_get_rsp_t *msg) {
+    hook_rsp_connection_channel_map_get(msg);
 }
 
 void ble_rsp_connection_channel_map_set(const struct ble_msg_connection_channel_map_set_rsp_t *msg) {
+    hook_rsp_connection(msg->connection, msg->result);
 }
 
 void ble_rsp_connection_features_get(const struct ble_msg_connection_features_get_rsp_t *msg) {
@@ -330,6 +340,7 @@ void ble_rsp_attclient_find_by_type_value(const struct ble_msg_attclient_find_by
     } else {
         setFlag(app_state, APP_COMMAND_ERROR);
     }
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_read_by_group_type(const struct ble_msg_attclient_read_by_group_type_rsp_t *msg) {
@@ -339,6 +350,7 @@ void ble_rsp_attclient_read_by_group_type(const struct ble_msg_attclient_read_by
     } else {
         setFlag(app_state, APP_COMMAND_ERROR);
     }
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_read_by_type(const struct ble_msg_attclient_read_by_type_rsp_t *msg) {
@@ -348,6 +360,7 @@ void ble_rsp_attclient_read_by_type(const struct ble_msg_attclient_read_by_type_
     } else {
         setFlag(app_state, APP_COMMAND_ERROR);
     }
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_find_information(const struct ble_msg_attclient_find_information_rsp_t *msg) {
@@ -357,6 +370,7 @@ void ble_rsp_attclient_find_information(const struct ble_msg_attclient_find_info
     } else {
         setFlag(app_state, APP_COMMAND_ERROR);
     }
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_read_by_handle(const struct ble_msg_attclient_read_by_handle_rsp_t *msg) {
@@ -366,6 +380,7 @@ void ble_rsp_attclient_read_by_handle(const struct ble_msg_attclient_read_by_han
     } else {
         setFlag(app_state, APP_COMMAND_ERROR);
     }
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_attclient_attribute_write(const struct ble_msg_attclient_attribute_write_rsp_t *msg) {
@@ -375,6 +390,7 @@ void ble_rsp_attclient_attribute_write(const struct ble_msg_attclient_attribute_
     } else {
         setFlag(app_state, APP_COMMAND_ERROR);
     }
+    hook_rsp_attclient(msg->connection, msg->result);
 }
 
 void ble_rsp_sm_encrypt_start(const struct ble_msg_sm_encrypt_start_rsp_t *msg) {
@@ -394,6 +410,9 @@ void ble_rsp_gap_set_mode(const struct ble_msg_gap_set_mode_rsp_t *msg) {
 
 void ble_rsp_gap_discover(const struct ble_msg_gap_discover_rsp_t *msg) {
     printf("[<] ble_rsp_gap_discover\n");
+    if (hook_rsp_command(msg->result)) {
+        return;
+    }
     if (msg->result == 0) {
         clearFlag(app_state, APP_COMMAND_PENDING);
     } else {
@@ -412,14 +431,22 @@ void ble_rsp_gap_connect_direct(const struct ble_msg_gap_connect_direct_rsp_t *m
 
 void ble_rsp_gap_end_procedure(const struct ble_msg_gap_end_procedure_rsp_t *msg) {
     printf("[<] ble_rsp_gap_end_procedure, result: 0x%04X\n", msg->result);
+    if (hook_rsp_command(msg->result)) {
+        return;
+    }
     clearFlag(app_state, APP_COMMAND_PENDING);
-
 }
 
 void ble_rsp_hardware_io_port_config_irq(const struct ble_msg_hardware_io_port_config_irq_rsp_t *msg) {
 }
 
 void ble_rsp_hardware_set_soft_timer(const struct ble_msg_hardware_set_soft_timer_rsp_t *msg) {
+    printf("[<] ble_rsp_hardware_set_soft_timer, result: 0x%04X\n", msg->result);
+    if (hook_rsp_command(msg->result)) {
+        return;
+    }
+    /* without the timer the loops only wake up on traffic, not fatal */
+    clearFlag(app_state, APP_COMMAND_PENDING);
 }
 
 void ble_rsp_hardware_adc_read(const struct ble_msg_hardware_adc_read_rsp_t *msg) {
@@ -472,10 +499,13 @@ void ble_evt_connection_status(const struct ble_msg_connection_status_evt_t *msg
     if (msg->flags == (connection_connected | connection_completed)) {
         printf("\tConnected\n");
         app_connection.state = APP_DEVICE_CONNECTED;
+        app_connection.handle = msg->connection;
     } else {
         printf("\tNot Connected\n");
         app_connection.state = APP_DEVICE_DICONNECTED;
     }
+
+    hook_evt_connection_status(msg);
 }
 
 void ble_evt_connection_version_ind(const struct ble_msg_connection_version_ind_evt_t *msg) {
@@ -489,8 +519,12 @@ void ble_evt_connection_raw_rx(const struct ble_msg_connection_raw_rx_evt_t *msg
 
 void ble_evt_connection_disconnected(const struct ble_msg_connection_disconnected_evt_t *msg) {
     printf("[<] ble_evt_connection_disconnected\n");
-    printf("[>] ble_cmd_connection_get_status\n");
-    ble_cmd_connection_get_status(0);
+    hook_evt_connection_disconnected(msg);
+
+    if (msg->connection == app_connection.handle) {
+        app_connection.state = APP_DEVICE_DICONNECTED;
+        clearFlag(app_state, APP_ATTCLIENT_PENDING);
+    }
 }
 
 void ble_evt_attclient_indicated(const struct ble_msg_attclient_indicated_evt_t *msg) {
@@ -498,6 +532,9 @@ void ble_evt_attclient_indicated(const struct ble_msg_attclient_indicated_evt_t
 
 void ble_evt_attclient_procedure_completed(const struct ble_msg_attclient_procedure_completed_evt_t *msg) {
     printf("[<] ble_evt_attclient_procedure_completed, handle: 0x%04X, result: 0x%04X\n", msg->chrhandle, msg->result);
+    if (hook_evt_attclient_procedure_completed(msg)) {
+        return;
+    }
     clearFlag(app_state, APP_ATTCLIENT_PENDING);
 
     if (msg->result != 0) {
@@ -512,9 +549,12 @@ void ble_evt_attclient_group_found(const struct ble_msg_attclient_group_found_ev
     printf("\tUUID (Hex): ");
     printUUID((uint8 *)msg->uuid.data, msg->uuid.len);
     printf("\n");
+
+    hook_evt_attclient_group_found(msg);
 }
 
 void ble_evt_attclient_attribute_found(const struct ble_msg_attclient_attribute_found_evt_t *msg) {
+    hook_evt_attclient_attribute_found(msg);
 }
 
 void ble_evt_attclient_find_information_found(const struct ble_msg_attclient_find_information_found_evt_t *msg) {
@@ -524,9 +564,24 @@ void ble_evt_attclient_find_information_found(const struct ble_msg_attclient_fin
     printf("\tUUID (Hex): ");
     printUUID((uint8 *)msg->uuid.data, msg->uuid.len);
     printf("\n");
+
+    hook_evt_attclient_find_information_found(msg);
 }
 
 void ble_evt_attclient_attribute_value(const struct ble_msg_attclient_attribute_value_evt_t *msg) {
+    /* first of all, an indication is confirmed from here */
+    hook_evt_attclient_attribute_value(msg);
+
+    switch (msg->type) {
+    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_NOTIFY:
+    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE:
+    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE_RSP_REQ:
+        /* queued by the hook, far too many to print */
+        return;
+    default:
+        break;
+    }
+
     printf("[<] ble_evt_attclient_attribute_value\n");
     printf("\tConn: 0x%02x\n", msg->connection);
     printf("\tHandle: 0x%04x\n", msg->atthandle);
@@ -537,26 +592,15 @@ void ble_evt_attclient_attribute_value(const struct ble_msg_attclient_attribute_
     memcpy(app_attclient.value.data, msg->value.data, msg->value.len * sizeof(uint8));
     app_attclient.value.len = msg->value.len;
     app_attclient.handle = msg->atthandle;
-
-    switch (msg->type) {
-    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_NOTIFY:
-        setFlag(app_state, APP_ATTCLIENT_NOTIFICATION_PENDING);
-        break;
-    default:
-        setFlag(app_state, APP_ATTCLIENT_VALUE_PENDING);
-        break;
-    }
+    setFlag(app_state, APP_ATTCLIENT_VALUE_PENDING);
 }
 
 void ble_evt_sm_smp_data(const struct ble_msg_sm_smp_data_evt_t *msg) {
 }
 
 void ble_evt_gap_scan_response(const struct ble_msg_gap_scan_response_evt_t *msg) {
-    printf("[<] ble_evt_gap_scan_response\n");
-    printf("\tScan response from: ");
-    printAddr6((uint8 *)msg->sender.addr, ':');
-    printf("\n");
-    printf("\t%d\n", msg->rssi);
+    /* far too many to print, Scanner keeps them */
+    hook_evt_gap_scan_response(msg);
 }
 
 void ble_evt_gap_mode_changed(const struct ble_msg_gap_mode_changed_evt_t *msg) {
@@ -566,6 +610,7 @@ void ble_evt_hardware_io_port_status(const struct ble_msg_hardware_io_port_statu
 }
 
 void ble_evt_hardware_soft_timer(const struct ble_msg_hardware_soft_timer_evt_t *msg) {
+    /* nothing to do, it only wakes the loop that called ReadBleMessage() */
 }
 
 void ble_evt_hardware_adc_result(const struct ble_msg_hardware_adc_result_evt_t *msg) {
@@ -0,0 +1,319 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/connectionmanager.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+
+
+std::vector<ConnectionManager::Target> ConnectionManager::targets_;
+ConnectionParameters ConnectionManager::parameters_ = { 80, 3200, 1000, 0 };
+uint32 ConnectionManager::max_links_ = APP_MAX_CONNECTIONS;
+bool ConnectionManager::running_ = false;
+bool ConnectionManager::connecting_ = false;
+uint32 ConnectionManager::outstanding_ = 0;
+uint64_t ConnectionManager::retry_ms_ = 0;
+ConnectionManagerStats ConnectionManager::stats_;
+std::mt19937 ConnectionManager::random_((std::random_device())());
+
+
+void ConnectionManager::SetParameters(const ConnectionParameters& parameters) {
+    parameters_ = parameters;
+}
+
+
+/**
+ * @brief how many links the manager may use, at most APP_MAX_CONNECTIONS;
+ *        the dongle firmware may allow fewer
+ */
+void ConnectionManager::SetMaxLinks(uint32 links) {
+    max_links_ = links < APP_MAX_CONNECTIONS ? links : APP_MAX_CONNECTIONS;
+}
+
+
+ConnectionManager::Target* ConnectionManager::Find(const bd_addr& address, uint8 address_type) {
+    for (size_t i = 0; i < targets_.size(); i++) {
+        if (targets_[i].address_type == address_type
+                && memcmp(targets_[i].address.addr, address.addr, 6) == 0) {
+            return &targets_[i];
+        }
+    }
+    return NULL;
+}
+
+
+void ConnectionManager::AddTarget(const bd_addr& address, uint8 address_type) {
+    if (Find(address, address_type)) {
+        return;
+    }
+    Target t = Target();
+    t.address = address;
+    t.address_type = address_type;
+    targets_.push_back(t);
+}
+
+
+/**
+ * @brief stops connecting to a target, an existing link is left alone
+ */
+void ConnectionManager::RemoveTarget(const bd_addr& address, uint8 address_type) {
+    Target* t = Find(address, address_type);
+    if (!t) {
+        return;
+    }
+    if (t->whitelisted) {
+        EndProcedure();
+        Whitelist(*t, false);
+    }
+    targets_.erase(targets_.begin() + (t - &targets_[0]));
+}
+
+
+void ConnectionManager::Start() {
+    running_ = true;
+    retry_ms_ = 0;
+}
+
+
+/**
+ * @brief stops connecting, links stay up but are not restored
+ */
+void ConnectionManager::Stop() {
+    running_ = false;
+    EndProcedure();
+}
+
+
+/**
+ * @brief queues a command with AttScheduler, Poll() waits for its response
+ */
+void ConnectionManager::Send(const std::function<void(uint8)>& issue,
+                             const std::function<void(uint16)>& done) {
+    AttOp op = AttOp();
+    op.issue = issue;
+    op.done = [done](uint16 result) {
+        outstanding_--;
+        if (done) {
+            done(result);
+        }
+    };
+    outstanding_++;
+    AttScheduler::SubmitCommand(op);
+}
+
+
+void ConnectionManager::EndProcedure() {
+    if (!connecting_) {
+        return;
+    }
+    // whatever the answer, no procedure runs afterwards; what is sent next
+    // goes out after it
+    connecting_ = false;
+    Send([](uint8) { ble_cmd_gap_end_procedure(); }, nullptr);
+}
+
+
+/**
+ * @brief adds a target to or removes it from the dongle's whitelist, the
+ *        target is marked once the dongle confirmed
+ */
+void ConnectionManager::Whitelist(const Target& target, bool append) {
+    bd_addr address = target.address;
+    uint8 address_type = target.address_type;
+    Send([address, address_type, append](uint8) {
+             bd_addr a = address;
+             if (append) {
+                 ble_cmd_system_whitelist_append(a.addr, address_type);
+             } else {
+                 ble_cmd_system_whitelist_remove(a.addr, address_type);
+             }
+         },
+         [address, address_type, append](uint16 result) {
+             if (result) {
+                 stats_.whitelist_failures++;
+                 Failed(result);
+                 return;
+             }
+             stats_.whitelist_changes++;
+             if (Target* t = Find(address, address_type)) {
+                 t->whitelisted = append;
+             }
+         });
+}
+
+
+/**
+ * @brief a command was refused, Poll() tries again after kRetryMs
+ */
+void ConnectionManager::Failed(uint16 result) {
+    printf("[#] Connection manager command failed: 0x%04x\n", result);
+    retry_ms_ = SteadyClock::Ms() + kRetryMs;
+}
+
+
+/**
+ * @brief brings the whitelist up to date and keeps connect_selective
+ *        running while there is anything to connect to, one step per
+ *        answered command
+ */
+void ConnectionManager::Poll() {
+    if (!running_ || outstanding_) {
+        return;
+    }
+    uint64_t now = SteadyClock::Ms();
+    if (now < retry_ms_) {
+        return;
+    }
+
+    uint32 connected = 0;
+    for (size_t i = 0; i < targets_.size(); i++) {
+        connected += targets_[i].connected;
+    }
+    bool room = connected < max_links_;
+
+    bool changed = false;
+    bool any = false;
+    for (size_t i = 0; i < targets_.size(); i++) {
+        const Target& t = targets_[i];
+        bool eligible = room && !t.connected && t.next_attempt_ms <= now;
+        changed |= eligible != t.whitelisted;
+        any |= eligible && t.whitelisted;
+    }
+
+    if (changed) {
+        // the whitelist cannot change under a running procedure
+        if (connecting_) {
+            EndProcedure();
+            return;
+        }
+        for (size_t i = 0; i < targets_.size(); i++) {
+            const Target& t = targets_[i];
+            bool eligible = room && !t.connected && t.next_attempt_ms <= now;
+            if (eligible != t.whitelisted) {
+                Whitelist(t, eligible);
+            }
+        }
+        return;
+    }
+
+    if (any && !connecting_) {
+        ConnectionParameters p = parameters_;
+        connecting_ = true;
+        stats_.selective_starts++;
+        Send([p](uint8) {
+                 ble_cmd_gap_connect_selective(p.interval_min, p.interval_max,
+                                               p.timeout, p.latency);
+             },
+             [](uint16 result) {
+                 if (result) {
+                     connecting_ = false;
+                     stats_.selective_failures++;
+                     Failed(result);
+                 }
+             });
+    }
+}
+
+
+/**
+ * @return  true if the target is connected, its connection handle in
+ *          connection
+ */
+bool ConnectionManager::IsConnected(const bd_addr& address, uint8 address_type,
+                                    uint8* connection) {
+    const Target* t = Find(address, address_type);
+    if (!t || !t->connected) {
+        return false;
+    }
+    if (connection) {
+        *connection = t->connection;
+    }
+    return true;
+}
+
+
+void ConnectionManager::OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg) {
+    if (!(msg->flags & connection_connected) || !(msg->flags & connection_completed)) {
+        return;
+    }
+
+    Target* t = Find(msg->address, msg->address_type);
+    if (!t || t->connected) {
+        return;
+    }
+    // connect_selective ends with the link it made
+    connecting_ = false;
+    t->connected = true;
+    t->connection = msg->connection;
+    t->connected_ms = SteadyClock::Ms();
+    // the dongle does not drop it from the whitelist, Poll() will
+    stats_.connects++;
+}
+
+
+/**
+ * @brief backs off before the target is tried again
+ */
+void ConnectionManager::OnDisconnected(uint8 connection) {
+    for (size_t i = 0; i < targets_.size(); i++) {
+        Target& t = targets_[i];
+        if (!t.connected || t.connection != connection) {
+            continue;
+        }
+        uint64_t now = SteadyClock::Ms();
+        t.connected = false;
+        if (now - t.connected_ms >= kStableMs) {
+            t.failures = 0;
+        }
+        uint32 shift = t.failures < 7 ? t.failures : 7;
+        uint32 delay = kBackoffBaseMs << shift;
+        if (delay > kBackoffMaxMs) {
+            delay = kBackoffMaxMs;
+        }
+        // half fixed, half random
+        std::uniform_int_distribution<uint32> jitter(delay / 2, delay);
+        t.next_attempt_ms = now + jitter(random_);
+        t.failures++;
+        stats_.disconnects++;
+        printf("[#] Target lost, retrying in %llums\n",
+               static_cast<unsigned long long>(t.next_attempt_ms - now));
+        return;
+    }
+}
+
+
+ConnectionManagerStats ConnectionManager::Stats() {
+    ConnectionManagerStats stats = stats_;
+    stats.targets = targets_.size();
+    stats.connected = 0;
+    for (size_t i = 0; i < targets_.size(); i++) {
+        stats.connected += targets_[i].connected;
+    }
+    return stats;
+}
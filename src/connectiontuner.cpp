@@ -0,0 +1,232 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+
+#include "../inc/connectiontuner.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+
+
+ConnectionTuner::Link ConnectionTuner::links_[APP_MAX_CONNECTIONS];
+std::map<uint64_t, ConnectionPolicy> ConnectionTuner::policies_;
+ConnectionPolicy ConnectionTuner::default_policy_ = ConnectionPolicy::Default();
+uint32 ConnectionTuner::period_ms_ = 500;
+uint64_t ConnectionTuner::next_plan_ms_ = 0;
+
+
+ConnectionPolicy ConnectionPolicy::Default() {
+    ConnectionPolicy policy;
+    policy.fastest_interval = 8;        // 10ms
+    policy.slowest_interval = 400;      // 500ms
+    policy.idle_latency = 4;
+    policy.timeout = 1000;              // 10s
+    return policy;
+}
+
+
+uint64_t ConnectionTuner::Key(const bd_addr& address) {
+    uint64_t key = 0;
+    for (int i = 5; i >= 0; i--) {
+        key = (key << 8) | address.addr[i];
+    }
+    return key;
+}
+
+
+void ConnectionTuner::SetDefaultPolicy(const ConnectionPolicy& policy) {
+    default_policy_ = policy;
+}
+
+
+/**
+ * @brief limits for one device, from its next connection on
+ */
+void ConnectionTuner::SetPolicy(const bd_addr& address, const ConnectionPolicy& policy) {
+    policies_[Key(address)] = policy;
+}
+
+
+/**
+ * @brief how often the traffic of the links is looked at
+ */
+void ConnectionTuner::SetPeriod(uint32 milliseconds) {
+    period_ms_ = milliseconds ? milliseconds : 1;
+}
+
+
+void ConnectionTuner::Poll() {
+    uint64_t now = SteadyClock::Ms();
+    if (now < next_plan_ms_) {
+        return;
+    }
+    next_plan_ms_ = now + period_ms_;
+    for (uint8 c = 0; c < APP_MAX_CONNECTIONS; c++) {
+        if (links_[c].connected) {
+            Plan(c, now);
+        }
+    }
+}
+
+
+void ConnectionTuner::Plan(uint8 connection, uint64_t now) {
+    Link& link = links_[connection];
+    const ConnectionPolicy& policy = link.policy;
+
+    uint32 issued = AttScheduler::Stats(connection).data_issued;
+    uint32 events = link.notifications + (issued - link.last_issued);
+    link.notifications = 0;
+    link.last_issued = issued;
+    link.stats.events_per_second = events * 1000 / period_ms_;
+
+    uint16 interval = link.interval;
+    uint16 latency = link.latency;
+    if (AttScheduler::QueueDepth(connection) > 1) {
+        // a backlog, drain it as fast as allowed
+        link.idle_periods = 0;
+        interval = policy.fastest_interval;
+        latency = 0;
+    } else if (events) {
+        // enough connection events for kPacketsPerEvent packets each
+        link.idle_periods = 0;
+        uint32 per_second = (events * 1000 / period_ms_ + kPacketsPerEvent - 1)
+                          / kPacketsPerEvent;
+        uint32 wanted = 800 / (per_second ? per_second : 1);       // 1.25ms units
+        if (wanted < policy.fastest_interval) {
+            wanted = policy.fastest_interval;
+        }
+        if (wanted > policy.slowest_interval) {
+            wanted = policy.slowest_interval;
+        }
+        interval = wanted;
+        latency = 0;
+    } else if (++link.idle_periods >= kIdlePeriods) {
+        interval = policy.slowest_interval;
+        latency = policy.idle_latency;
+    }
+
+    // the parameters_change event never came, e.g. the peer ignored the
+    // request
+    if (link.pending && now - link.last_update_ms >= kPendingMs) {
+        link.pending = false;
+    }
+
+    // a quarter or less is not worth the update
+    uint32 change = interval > link.interval ? interval - link.interval : link.interval - interval;
+    if (link.pending || now - link.last_update_ms < kHoldMs
+            || (latency == link.latency && change * 4 <= link.interval)) {
+        return;
+    }
+    Update(connection, interval, latency, now);
+}
+
+
+void ConnectionTuner::Update(uint8 connection, uint16 interval, uint16 latency, uint64_t now) {
+    Link& link = links_[connection];
+
+    // the supervision timeout has to exceed (1 + latency) * interval * 2
+    uint32 needed = ((1 + latency) * interval * 2 * 125 + 999) / 1000 + 1;    // 10ms
+    uint32 timeout = link.policy.timeout > needed ? link.policy.timeout : needed;
+    if (timeout > 3200) {
+        timeout = 3200;
+    }
+
+    printf("[#] Connection %d: interval %u -> %u, latency %u\n", connection,
+           link.interval, interval, latency);
+    AttOp op = AttOp();
+    op.priority = kAttPriorityHigh;
+    op.completion = kAttCompletesOnResponse;
+    op.upkeep = true;
+    op.issue = [interval, latency, timeout](uint8 c) {
+        ble_cmd_connection_update(c, interval, interval, latency, timeout);
+    };
+    op.done = [connection](uint16 result) {
+        Link& link = links_[connection];
+        if (result && link.connected) {
+            link.pending = false;
+            link.stats.rejected++;
+        }
+    };
+    link.pending = true;
+    AttScheduler::Submit(connection, op);
+    link.last_update_ms = now;
+    link.stats.updates++;
+}
+
+
+void ConnectionTuner::OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    if (!(msg->flags & connection_connected)) {
+        return;
+    }
+
+    Link& link = links_[msg->connection];
+    if (msg->flags & connection_completed || !link.connected) {
+        uint64_t address = Key(msg->address);
+        std::map<uint64_t, ConnectionPolicy>::const_iterator it = policies_.find(address);
+        link = Link();
+        link.connected = true;
+        link.address = address;
+        link.policy = it == policies_.end() ? default_policy_ : it->second;
+        link.last_issued = AttScheduler::Stats(msg->connection).data_issued;
+    }
+    // the parameters in force, after a connect or an update
+    link.interval = msg->conn_interval;
+    link.latency = msg->latency;
+    link.timeout = msg->timeout;
+    link.stats.interval = msg->conn_interval;
+    link.stats.latency = msg->latency;
+    if (msg->flags & connection_parameters_change) {
+        link.pending = false;
+    }
+}
+
+
+void ConnectionTuner::OnDisconnected(uint8 connection) {
+    if (connection < APP_MAX_CONNECTIONS) {
+        links_[connection].connected = false;
+    }
+}
+
+
+/**
+ * @brief counts a notification or indication of the link
+ */
+void ConnectionTuner::OnNotification(uint8 connection) {
+    if (connection < APP_MAX_CONNECTIONS) {
+        links_[connection].notifications++;
+    }
+}
+
+
+ConnectionTunerStats ConnectionTuner::Stats(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return ConnectionTunerStats();
+    }
+    return links_[connection].stats;
+}
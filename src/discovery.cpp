@@ -0,0 +1,286 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "../inc/discovery.h"
+#include "../inc/attributedb.h"
+#include "../inc/attscheduler.h"
+#include "../inc/gattcache.h"
+#include "../inc/subscriptions.h"
+
+
+// The BLE112 uses the default ATT MTU of 23 bytes; a response carries as many
+// entries of equal length as fit behind its 2 byte header. Only used to
+// estimate how many ATT requests a procedure took on air.
+static const uint32 kAttMtu = 23;
+static const uint32 kServicesPerResponse = (kAttMtu - 2) / (4 + 2);         // 3
+static const uint32 kDeclarationsPerResponse = (kAttMtu - 2) / (2 + 5);     // 3
+static const uint32 kInformationPerResponse = (kAttMtu - 2) / (2 + 2);      // 5
+
+
+Discovery::Link Discovery::links_[APP_MAX_CONNECTIONS];
+
+
+/**
+ * @brief starts discovering the services, characteristics and descriptors of
+ *        a connection
+ * @param connection    connection handle, must be connected
+ * @param done          called once with 0 or the first error and the stats
+ * @return  false if a discovery is already running on the connection
+ */
+bool Discovery::Start(uint8 connection, const discovery_done& done) {
+    if (connection >= APP_MAX_CONNECTIONS || links_[connection].active) {
+        return false;
+    }
+
+    Link& link = links_[connection];
+    link.active = true;
+    link.reading_declarations = false;
+    link.outstanding = 0;
+    link.result = 0;
+    link.found_short = 0;
+    link.found_long = 0;
+    link.declarations.clear();
+    link.stats = DiscoveryStats();
+    link.done = done;
+
+    ReadServices(connection);
+    return true;
+}
+
+
+/**
+ * @return  true while a discovery of the connection has not finished
+ */
+bool Discovery::IsRunning(uint8 connection) {
+    return connection < APP_MAX_CONNECTIONS && links_[connection].active;
+}
+
+
+/**
+ * @brief step 1: all primary services in one procedure
+ */
+void Discovery::ReadServices(uint8 connection) {
+    AttOp op = AttOp();
+    op.priority = kAttPriorityBackground;
+    op.completion = kAttCompletesOnProcedure;
+    op.issue = [](uint8 c) {
+        uint8 uuid[] = GATT_PRIMARY_SERVICE_UUID;
+        links_[c].found_short = links_[c].found_long = 0;
+        ble_cmd_attclient_read_by_group_type(c, 0x0001, 0xFFFF, sizeof(uuid), uuid);
+    };
+    op.done = [connection](uint16 result) {
+        Link& link = links_[connection];
+        Completed(connection, result, kServicesPerResponse);
+        // services were collected by OnGroupFound
+        for (size_t i = 0; i < link.services.size() && !link.result; i++) {
+            ReadCharacteristics(connection, link.services[i]);
+        }
+        Finish(connection);
+    };
+
+    links_[connection].services.clear();
+    links_[connection].outstanding++;
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief step 2: the characteristic declarations of one service
+ */
+void Discovery::ReadCharacteristics(uint8 connection, const Range& service) {
+    AttOp op = AttOp();
+    op.priority = kAttPriorityBackground;
+    op.completion = kAttCompletesOnProcedure;
+    op.issue = [service](uint8 c) {
+        uint8 uuid[] = GATT_CHARACTERISTIC_DECLARATION_UUID;
+        Link& link = links_[c];
+        link.found_short = link.found_long = 0;
+        link.declarations.clear();
+        link.reading_declarations = true;
+        ble_cmd_attclient_read_by_type(c, service.start, service.end, sizeof(uuid), uuid);
+    };
+    op.done = [connection, service](uint16 result) {
+        Link& link = links_[connection];
+        link.reading_declarations = false;
+        Completed(connection, result, kDeclarationsPerResponse);
+
+        // step 3: descriptors sit between a value handle and the next
+        // declaration (or the end of the service); only look where there
+        // is room for one
+        std::vector<Range>& decls = link.declarations;
+        std::sort(decls.begin(), decls.end(),
+                  [](const Range& a, const Range& b) { return a.start < b.start; });
+        for (size_t i = 0; i < decls.size() && !link.result; i++) {
+            Range gap;
+            gap.start = decls[i].end + 1;
+            gap.end = i + 1 < decls.size() ? decls[i + 1].start - 1 : service.end;
+            if (decls[i].end < gap.start && gap.start <= gap.end) {
+                FindDescriptors(connection, gap);
+            }
+        }
+        decls.clear();
+        Finish(connection);
+    };
+
+    links_[connection].outstanding++;
+    links_[connection].stats.services++;
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief step 3: the descriptors behind one characteristic value
+ */
+void Discovery::FindDescriptors(uint8 connection, const Range& gap) {
+    AttOp op = AttOp();
+    op.priority = kAttPriorityBackground;
+    op.completion = kAttCompletesOnProcedure;
+    op.issue = [gap](uint8 c) {
+        links_[c].found_short = links_[c].found_long = 0;
+        ble_cmd_attclient_find_information(c, gap.start, gap.end);
+    };
+    op.done = [connection](uint16 result) {
+        Completed(connection, result, kInformationPerResponse);
+        Finish(connection);
+    };
+
+    links_[connection].outstanding++;
+    links_[connection].stats.descriptor_gaps++;
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief books a finished procedure
+ * @param per_response  16-bit UUID entries that fit into one ATT response,
+ *                      128-bit UUID entries always take one response each
+ */
+void Discovery::Completed(uint8 connection, uint16 result, uint32 per_response) {
+    Link& link = links_[connection];
+    link.outstanding--;
+    link.stats.procedures++;
+    // plus the request that is answered with "attribute not found"
+    link.stats.att_requests += (link.found_short + per_response - 1) / per_response
+                               + link.found_long + 1;
+
+    if (result != 0 && result != kResultAttributeNotFound && !link.result) {
+        link.result = result;
+    }
+}
+
+
+/**
+ * @brief reports the discovery once nothing is outstanding anymore
+ */
+void Discovery::Finish(uint8 connection) {
+    Link& link = links_[connection];
+    if (!link.active || link.outstanding) {
+        return;
+    }
+    link.active = false;
+
+    if (!link.result) {
+        GattCache::Store(connection);
+        if (AttributeDb* db = AttributeDb::ForConnection(connection)) {
+            if (const std::vector<GattAttribute>* attributes =
+                    GattCache::Attributes(connection)) {
+                db->Build(*attributes);
+            }
+        }
+        SubscriptionManager::OnDatabaseReady(connection);
+    }
+
+    printf("[#] Discovery of connection %d: %lu procedures, ~%lu ATT requests, "
+           "%lu services, %lu characteristics, %lu descriptor ranges\n",
+           connection, link.stats.procedures, link.stats.att_requests,
+           link.stats.services, link.stats.characteristics,
+           link.stats.descriptor_gaps);
+
+    discovery_done done;
+    done.swap(link.done);
+    if (done) {
+        done(link.result, link.stats);
+    }
+}
+
+
+void Discovery::OnGroupFound(const struct ble_msg_attclient_group_found_evt_t* msg) {
+    if (!IsRunning(msg->connection)) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    Range service;
+    service.start = msg->start;
+    service.end = msg->end;
+    link.services.push_back(service);
+    msg->uuid.len == 16 ? link.found_long++ : link.found_short++;
+}
+
+
+/**
+ * @brief parses a characteristic declaration returned by read_by_type:
+ *        properties (1), value handle (2), UUID (2 or 16)
+ */
+void Discovery::OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg) {
+    if (!IsRunning(msg->connection)
+            || msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_READ_BY_TYPE) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    if (!link.reading_declarations
+            || (msg->value.len != 5 && msg->value.len != 19)) {
+        return;
+    }
+
+    GattAttribute a = GattAttribute();
+    a.handle = msg->atthandle;
+    a.end = msg->value.data[1] | (msg->value.data[2] << 8);
+    a.kind = kGattCharacteristic;
+    a.properties = msg->value.data[0];
+    a.uuid_len = msg->value.len - 3;
+    memcpy(a.uuid, msg->value.data + 3, a.uuid_len);
+    GattCache::Record(msg->connection, a);
+
+    Range declaration;
+    declaration.start = a.handle;
+    declaration.end = a.end;
+    link.declarations.push_back(declaration);
+    link.stats.characteristics++;
+    a.uuid_len == 16 ? link.found_long++ : link.found_short++;
+}
+
+
+void Discovery::OnInformationFound(const struct ble_msg_attclient_find_information_found_evt_t* msg) {
+    if (!IsRunning(msg->connection)) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    msg->uuid.len == 16 ? link.found_long++ : link.found_short++;
+}
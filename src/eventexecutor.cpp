@@ -0,0 +1,377 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../inc/eventexecutor.h"
+#include "../inc/config.h"
+
+
+// ordering keys are spread over this many strands
+static const int kStrands = 64;
+// a strand runs this many tasks before it goes back to the ready queue
+static const int kStrandBatch = 32;
+// messages a strand can hold, a power of two
+static const uint32 kStrandSlots = 128;
+
+/* Copy of one message, the reader's buffer is re-used right away */
+struct EventTask {
+    int msg_idx;
+    uint8 data[256];
+};
+
+/*
+ * Tasks of one ordering key, executed by one worker at a time. The ring is
+ * written by the reader only and read by the worker that holds the strand,
+ * so neither side locks.
+ */
+struct Strand {
+    EventTask* ring;                    // kStrandSlots, allocated by Start()
+    std::atomic<uint32> head;           // next slot the reader writes
+    std::atomic<uint32> tail;           // next slot to run
+    std::atomic<bool> scheduled;        // queued or held by a worker
+};
+
+/*
+ * Strands the reader made ready, bounded and lock free (D. Vyukov's MPMC
+ * queue). A strand is in at most one queue at a time, so kStrands cells
+ * never run out.
+ */
+class ReadyQueue {
+    public:
+    ReadyQueue() : enqueue_pos_(0), dequeue_pos_(0) {
+        for (size_t i = 0; i < kStrands; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(Strand* strand) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos % kStrands];
+            intptr_t diff = static_cast<intptr_t>(cell->seq.load(std::memory_order_acquire))
+                            - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->strand = strand;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    Strand* Pop() {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos % kStrands];
+            intptr_t diff = static_cast<intptr_t>(cell->seq.load(std::memory_order_acquire))
+                            - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        Strand* strand = cell->strand;
+        cell->seq.store(pos + kStrands, std::memory_order_release);
+        return strand;
+    }
+
+    bool Empty() const {
+        return enqueue_pos_.load() == dequeue_pos_.load();
+    }
+
+    private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        Strand* strand;
+    };
+
+    Cell cells_[kStrands];
+    std::atomic<size_t> enqueue_pos_;
+    std::atomic<size_t> dequeue_pos_;
+};
+
+/* Strands a worker gave back after a batch, the owner takes from the front, thieves from the back */
+struct Worker {
+    std::mutex lock;
+    std::deque<Strand*> ready;
+};
+
+
+std::vector<event_processor> EventExecutor::processors_[EventExecutor::kMaxMessages];
+bool EventExecutor::running_ = false;
+
+static Strand                    strands_[kStrands];
+static ReadyQueue                ready_;
+static std::vector<Worker*>      workers_;
+static std::vector<std::thread*> threads_;
+static std::atomic<bool>         stopping_(false);
+static std::atomic<uint32>       backlog_(0);
+static std::atomic<uint32>       dropped_(0);
+static std::atomic<unsigned>     sleepers_(0);
+static std::mutex                idle_mutex_;
+static std::condition_variable   idle_cv_;
+
+
+/**
+ * @brief registers a processor for one message type
+ * @param msg_idx       index from enum ble_msg_idx, e.g. ble_evt_attclient_attribute_value_idx
+ * @param processor     called with the message's payload struct
+ */
+void EventExecutor::Subscribe(int msg_idx, const event_processor& processor) {
+    if (msg_idx >= 0 && msg_idx < kMaxMessages) {
+        processors_[msg_idx].push_back(processor);
+    }
+}
+
+
+/**
+ * @brief starts the worker threads. Without Start() processors run inline.
+ * @param threads   no. of workers, 0 picks one per core
+ */
+void EventExecutor::Start(unsigned threads) {
+    if (running_) {
+        return;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    stopping_ = false;
+    for (int i = 0; i < kStrands; i++) {
+        if (!strands_[i].ring) {
+            strands_[i].ring = new EventTask[kStrandSlots];
+        }
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers_.push_back(new Worker);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        threads_.push_back(new std::thread(WorkerLoop, i));
+    }
+    running_ = true;
+}
+
+
+/**
+ * @brief finishes all posted messages and stops the workers
+ */
+void EventExecutor::Stop() {
+    if (!running_) {
+        return;
+    }
+
+    while (backlog_.load() != 0) {
+        std::this_thread::yield();
+    }
+
+    stopping_ = true;
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cv_.notify_all();
+    }
+    for (size_t i = 0; i < threads_.size(); i++) {
+        threads_[i]->join();
+        delete threads_[i];
+    }
+    // only now, the last workers may still have looked into the others' queues
+    for (size_t i = 0; i < workers_.size(); i++) {
+        delete workers_[i];
+    }
+    threads_.clear();
+    workers_.clear();
+    running_ = false;
+}
+
+
+/**
+ * @brief hands a message that was just dispatched by ReadBleMessage() to the
+ *        processors subscribed to it
+ * @param api_msg   message description as returned by ble_get_msg_hdr()
+ * @param data      payload
+ * @param len       no. of byte in data
+ */
+void EventExecutor::Post(const struct ble_msg* api_msg, const uint8* data, uint8 len) {
+    int msg_idx = static_cast<int>(api_msg - ble_get_msg(0));
+    if (msg_idx < 0 || msg_idx >= kMaxMessages || processors_[msg_idx].empty()) {
+        return;
+    }
+
+    if (!running_) {
+        Run(msg_idx, data);
+        return;
+    }
+
+    // first byte of every connection and attclient message is the connection
+    unsigned key;
+    if ((api_msg->hdr.cls == ble_cls_connection
+            || api_msg->hdr.cls == ble_cls_attclient) && len > 0) {
+        key = data[0];
+    } else {
+        key = APP_MAX_CONNECTIONS + msg_idx;
+    }
+    Strand& strand = strands_[key % kStrands];
+
+    // the reader must never wait: a strand that is this far behind loses
+    // the message
+    uint32 head = strand.head.load(std::memory_order_relaxed);
+    if (head - strand.tail.load(std::memory_order_acquire) == kStrandSlots) {
+        dropped_++;
+        return;
+    }
+    EventTask& task = strand.ring[head % kStrandSlots];
+    task.msg_idx = msg_idx;
+    memcpy(task.data, data, len);
+    memset(task.data + len, 0, sizeof(task.data) - len);
+
+    backlog_++;
+    strand.head.store(head + 1);
+
+    if (!strand.scheduled.exchange(true)) {
+        ready_.Push(&strand);
+        // without the mutex, a sleeper that misses it wakes on its timeout
+        if (sleepers_.load()) {
+            idle_cv_.notify_one();
+        }
+    }
+}
+
+
+/**
+ * @brief calls the processors of a message
+ */
+void EventExecutor::Run(int msg_idx, const uint8* data) {
+    const std::vector<event_processor>& processors = processors_[msg_idx];
+    for (size_t i = 0; i < processors.size(); i++) {
+        processors[i](data);
+    }
+}
+
+
+/**
+ * @brief body of a worker thread
+ * @param worker    index of the worker's own ready queue
+ */
+void EventExecutor::WorkerLoop(unsigned worker) {
+    Worker* own = workers_[worker];
+
+    while (true) {
+        Strand* strand = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(own->lock);
+            if (!own->ready.empty()) {
+                strand = own->ready.front();
+                own->ready.pop_front();
+            }
+        }
+
+        if (!strand) {
+            strand = ready_.Pop();
+        }
+
+        // steal from the back of the others
+        for (size_t i = 1; !strand && i < workers_.size(); i++) {
+            Worker* victim = workers_[(worker + i) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim->lock);
+            if (!victim->ready.empty()) {
+                strand = victim->ready.back();
+                victim->ready.pop_back();
+            }
+        }
+
+        if (!strand) {
+            if (stopping_) {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            sleepers_++;
+            if (ready_.Empty()) {
+                idle_cv_.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            sleepers_--;
+            continue;
+        }
+
+        bool drained = false;
+        for (int n = 0; n < kStrandBatch && !drained; n++) {
+            uint32 tail = strand->tail.load(std::memory_order_relaxed);
+            if (tail == strand->head.load()) {
+                // from here on Post() may hand the strand to anyone, unless
+                // it posted in between and still saw it scheduled
+                strand->scheduled = false;
+                drained = tail == strand->head.load() || strand->scheduled.exchange(true);
+                continue;
+            }
+            const EventTask& task = strand->ring[tail % kStrandSlots];
+            Run(task.msg_idx, task.data);
+            strand->tail.store(tail + 1, std::memory_order_release);
+            backlog_--;
+        }
+
+        // batch used up, the strand is still ours: give the others a turn
+        if (!drained) {
+            std::lock_guard<std::mutex> lock(own->lock);
+            own->ready.push_back(strand);
+        }
+    }
+}
+
+
+/**
+ * @return  no. of posted messages not processed yet
+ */
+uint32 EventExecutor::Backlog() {
+    return backlog_;
+}
+
+
+/**
+ * @return  no. of messages lost because their strand was full
+ */
+uint32 EventExecutor::Dropped() {
+    return dropped_;
+}
@@ -0,0 +1,364 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+
+#include <utility>
+
+#include "../inc/fleetsweep.h"
+#include "../inc/attributedb.h"
+#include "../inc/attscheduler.h"
+#include "../inc/connectionmanager.h"
+#include "../inc/discovery.h"
+#include "../inc/gattcache.h"
+#include "../inc/readaggregator.h"
+#include "../inc/steadyclock.h"
+
+
+std::vector<SweepDevice> FleetSweep::devices_;
+std::vector<SweepCharacteristic> FleetSweep::characteristics_;
+sweep_result_sink FleetSweep::sink_;
+std::vector<FleetSweep::Job> FleetSweep::jobs_;
+size_t FleetSweep::next_device_ = 0;
+uint64_t FleetSweep::started_ms_ = 0;
+uint64_t FleetSweep::finished_ms_ = 0;
+uint64_t FleetSweep::last_poll_ms_ = 0;
+uint32 FleetSweep::connect_timeout_ms_ = 10000;
+uint32 FleetSweep::device_timeout_ms_ = 30000;
+FleetSweepStats FleetSweep::stats_;
+
+
+/**
+ * @param connect_ms    how long a device may take to connect, not counting
+ *                      the time all links were taken
+ * @param device_ms     how long a device may take from connect to disconnect
+ */
+void FleetSweep::SetTimeouts(uint32 connect_ms, uint32 device_ms) {
+    connect_timeout_ms_ = connect_ms;
+    device_timeout_ms_ = device_ms;
+}
+
+
+/**
+ * @brief starts a sweep, ConnectionManager is started as well and stopped
+ *        when the sweep is over
+ * @param devices           to read from, in this order
+ * @param characteristics   read from every device
+ * @param sink              gets the result of each device, may be empty
+ * @return  false if a sweep is running already
+ */
+bool FleetSweep::Start(const std::vector<SweepDevice>& devices,
+                       const std::vector<SweepCharacteristic>& characteristics,
+                       const sweep_result_sink& sink) {
+    if (IsRunning()) {
+        return false;
+    }
+    devices_ = devices;
+    characteristics_ = characteristics;
+    sink_ = sink;
+    jobs_.clear();
+    next_device_ = 0;
+    stats_ = FleetSweepStats();
+    stats_.devices = devices_.size();
+    started_ms_ = SteadyClock::Ms();
+    finished_ms_ = 0;
+    last_poll_ms_ = started_ms_;
+    if (!ConnectionManager::IsRunning()) {
+        ConnectionManager::Start();
+    }
+    return true;
+}
+
+
+bool FleetSweep::IsRunning() {
+    return next_device_ < devices_.size() || !jobs_.empty();
+}
+
+
+void FleetSweep::Poll() {
+    if (!IsRunning()) {
+        return;
+    }
+    uint64_t now = SteadyClock::Ms();
+    ConnectionManager::Poll();
+    ReadAggregator::Poll();
+
+    // waiting for a free link does not count against the connect timeout
+    bool room = ConnectionManager::Stats().connected < ConnectionManager::MaxLinks();
+    uint64_t passed = room ? 0 : now - last_poll_ms_;
+    last_poll_ms_ = now;
+
+    size_t waiting = 0;
+    for (size_t i = jobs_.size(); i-- > 0; ) {
+        Job& job = jobs_[i];
+        if (job.state == kJobWaiting) {
+            uint8 connection;
+            const SweepDevice& device = job.result.device;
+            job.connect_deadline_ms += passed;
+            if (ConnectionManager::IsConnected(device.address, device.address_type,
+                                               &connection)) {
+                Connected(&job, connection, now);
+            } else if (now >= job.connect_deadline_ms) {
+                ConnectionManager::RemoveTarget(device.address, device.address_type);
+                job.result.result = kResultTimeout;
+                Finish(i, now);
+            } else {
+                waiting++;
+            }
+        } else if (job.state != kJobDisconnecting) {
+            if (now - job.connected_ms >= device_timeout_ms_) {
+                Disconnect(&job, kResultTimeout);
+            }
+        } else if (now - job.disconnect_ms >= kDisconnectMs) {
+            if (job.disconnects < kDisconnectTries) {
+                SendDisconnect(&job, now);
+            } else {
+                printf("[#] Connection %d does not disconnect, given up\n", job.connection);
+                if (!job.result.result) {
+                    job.result.result = kResultTimeout;
+                }
+                Finish(i, now);
+            }
+        }
+    }
+
+    // the next devices connect while the others are being read
+    while (waiting < kMaxWaiting && next_device_ < devices_.size()) {
+        Job job = Job();
+        job.state = kJobWaiting;
+        job.queued_ms = now;
+        job.connect_deadline_ms = now + connect_timeout_ms_;
+        job.result.device = devices_[next_device_++];
+        ConnectionManager::AddTarget(job.result.device.address, job.result.device.address_type);
+        jobs_.push_back(job);
+        waiting++;
+    }
+
+    if (!IsRunning()) {
+        finished_ms_ = now;
+        ConnectionManager::Stop();
+        FleetSweepStats stats = Stats();
+        printf("[#] Swept %lu devices, %lu failed, in %llu ms: %1.1f devices/minute\n",
+               stats.done, stats.failed, static_cast<unsigned long long>(stats.elapsed_ms),
+               stats.devices_per_minute);
+    }
+}
+
+
+FleetSweep::Job* FleetSweep::ForConnection(uint8 connection) {
+    for (size_t i = 0; i < jobs_.size(); i++) {
+        if (jobs_[i].state != kJobWaiting && jobs_[i].connection == connection) {
+            return &jobs_[i];
+        }
+    }
+    return nullptr;
+}
+
+
+/**
+ * @brief reads right away with a cached layout, discovers otherwise
+ */
+void FleetSweep::Connected(Job* job, uint8 connection, uint64_t now) {
+    job->connection = connection;
+    job->connected_ms = now;
+    job->result.connect_ms = now - job->queued_ms;
+    job->result.cache_hit = GattCache::IsHit(connection);
+
+    if (job->result.cache_hit) {
+        stats_.cache_hits++;
+        job->state = kJobReading;
+        Read(connection);
+        return;
+    }
+
+    // stored in GattCache and built into the AttributeDb by Discovery
+    job->state = kJobDiscovering;
+    Discovery::Start(connection, [connection](uint16 result, const DiscoveryStats&) {
+        Job* job = ForConnection(connection);
+        if (!job || job->state != kJobDiscovering) {
+            return;
+        }
+        if (result) {
+            Disconnect(job, result);
+            return;
+        }
+        job->state = kJobReading;
+        Read(connection);
+    });
+}
+
+
+void FleetSweep::Read(uint8 connection) {
+    Job* job = ForConnection(connection);
+    AttributeDb* db = AttributeDb::ForConnection(connection);
+    const std::vector<GattAttribute>* attributes = GattCache::Attributes(connection);
+    if (db->Empty() && attributes) {
+        db->Build(*attributes);
+    }
+
+    job->result.values.assign(characteristics_.size(), std::vector<uint8>());
+    // held while queueing, so a read failing right away cannot finish early
+    job->reads = 1;
+    for (size_t i = 0; i < characteristics_.size(); i++) {
+        uint16 handle = db->ValueHandle(characteristics_[i].uuid, characteristics_[i].uuid_len);
+        if (!handle) {
+            job->result.missing++;
+            continue;
+        }
+        job->reads++;
+        ReadAggregator::Read(connection, handle, 0,
+                             [connection, i](uint16 result, const uint8* data, uint8 len) {
+                                 ValueRead(connection, i, result, data, len);
+                             });
+    }
+    ReadAggregator::Flush(connection);
+    ValueRead(connection, characteristics_.size(), 0, nullptr, 0);
+}
+
+
+void FleetSweep::ValueRead(uint8 connection, size_t index, uint16 result,
+                           const uint8* data, uint8 len) {
+    Job* job = ForConnection(connection);
+    if (!job || job->state != kJobReading) {
+        return;
+    }
+    if (index < job->result.values.size()) {
+        if (result) {
+            if (!job->result.result) {
+                job->result.result = result;
+            }
+        } else {
+            job->result.values[index].assign(data, data + len);
+        }
+    }
+    if (!--job->reads) {
+        job->result.read_ms = SteadyClock::Ms() - job->connected_ms;
+        Disconnect(job, 0);
+    }
+}
+
+
+void FleetSweep::Disconnect(Job* job, uint16 result) {
+    if (!job->result.result) {
+        job->result.result = result;
+    }
+    // or ConnectionManager would connect it again
+    ConnectionManager::RemoveTarget(job->result.device.address, job->result.device.address_type);
+    job->state = kJobDisconnecting;
+    SendDisconnect(job, SteadyClock::Ms());
+}
+
+
+void FleetSweep::SendDisconnect(Job* job, uint64_t now) {
+    job->disconnect_ms = now;
+    job->disconnects++;
+
+    uint8 connection = job->connection;
+    AttOp op = AttOp();
+    op.issue = [connection](uint8) {
+        ble_cmd_connection_disconnect(connection);
+    };
+    op.done = [connection](uint16 result) {
+        Disconnected(connection, result);
+    };
+    AttScheduler::SubmitCommand(op);
+}
+
+
+/**
+ * @brief checks the response to a disconnect, the job itself ends with the
+ *        disconnected event
+ */
+void FleetSweep::Disconnected(uint8 connection, uint16 result) {
+    Job* job = ForConnection(connection);
+    if (!result || !job || job->state != kJobDisconnecting) {
+        return;
+    }
+    if (result == AttScheduler::kResultNotConnected) {
+        // gone already, its event will not come
+        Finish(job - &jobs_[0], SteadyClock::Ms());
+        return;
+    }
+    // sent again by Poll() right away, as long as tries are left
+    printf("[#] Disconnecting connection %d failed: 0x%04x\n", connection, result);
+    job->disconnect_ms = 0;
+}
+
+
+void FleetSweep::Finish(size_t index, uint64_t now) {
+    SweepResult result = SweepResult();
+    std::swap(result, jobs_[index].result);
+    result.total_ms = now - jobs_[index].queued_ms;
+    jobs_.erase(jobs_.begin() + index);
+
+    stats_.done++;
+    if (result.result) {
+        stats_.failed++;
+    } else {
+        if (!stats_.latency_min_ms || result.total_ms < stats_.latency_min_ms) {
+            stats_.latency_min_ms = result.total_ms;
+        }
+        if (result.total_ms > stats_.latency_max_ms) {
+            stats_.latency_max_ms = result.total_ms;
+        }
+        stats_.latency_sum_ms += result.total_ms;
+    }
+    if (sink_) {
+        sink_(result);
+    }
+}
+
+
+/**
+ * @brief to be called before the other modules see the disconnect, so the
+ *        reads they fail are not taken for the device's answer
+ */
+void FleetSweep::OnDisconnected(uint8 connection) {
+    Job* job = ForConnection(connection);
+    if (!job) {
+        return;
+    }
+    if (job->state != kJobDisconnecting) {
+        // lost on the way
+        if (!job->result.result) {
+            job->result.result = AttScheduler::kResultNotConnected;
+        }
+        ConnectionManager::RemoveTarget(job->result.device.address,
+                                        job->result.device.address_type);
+    }
+    Finish(job - &jobs_[0], SteadyClock::Ms());
+}
+
+
+FleetSweepStats FleetSweep::Stats() {
+    FleetSweepStats stats = stats_;
+    uint64_t end = finished_ms_ ? finished_ms_ : SteadyClock::Ms();
+    stats.elapsed_ms = started_ms_ ? end - started_ms_ : 0;
+    if (stats.elapsed_ms) {
+        stats.devices_per_minute = stats.done * 60000.0 / stats.elapsed_ms;
+    }
+    return stats;
+}
@@ -0,0 +1,370 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "../inc/gattcache.h"
+
+
+namespace bip = ::boost::interprocess;
+
+
+/* File header, followed by 'count' GattAttribute records */
+struct GattCacheHeader {
+    char magic[4];
+    uint8 version;
+    uint8 address_type;
+    uint16 count;
+    uint8 address[6];
+    uint8 reserved[2];
+};
+
+static_assert(sizeof(GattCacheHeader) == 16, "cache file header layout is part of the file format");
+static_assert(sizeof(GattAttribute) == 24, "cache file record layout is part of the file format");
+
+static const char  kMagic[4] = { 'G', 'A', 'T', 'C' };
+static const uint8 kVersion  = 1;
+
+
+GattCache::Link GattCache::links_[APP_MAX_CONNECTIONS];
+std::string GattCache::directory_ = ".gattcache";
+
+
+/**
+ * @brief sets (and creates) the directory holding the cache files
+ */
+void GattCache::SetDirectory(const std::string& directory) {
+    directory_ = directory;
+#ifdef _WIN32
+    _mkdir(directory_.c_str());
+#else
+    mkdir(directory_.c_str(), 0755);
+#endif
+}
+
+
+/**
+ * @return  path of the cache file, e.g. ".gattcache/0007806af289-0.gatt"
+ */
+std::string GattCache::FileName(const bd_addr& address, uint8 address_type) {
+    char name[32];
+    // bd_addr is stored least significant byte first
+    snprintf(name, sizeof(name), "%02x%02x%02x%02x%02x%02x-%d.gatt",
+             address.addr[5], address.addr[4], address.addr[3],
+             address.addr[2], address.addr[1], address.addr[0],
+             address_type);
+    return directory_ + "/" + name;
+}
+
+
+/**
+ * @brief maps the cache file of a link and takes over its attributes
+ * @return  true on a valid entry
+ */
+bool GattCache::Load(Link* link) {
+    std::string path = FileName(link->address, link->address_type);
+
+    try {
+        bip::file_mapping file(path.c_str(), bip::read_only);
+        bip::mapped_region region(file, bip::read_only);
+
+        const uint8* base = static_cast<const uint8*>(region.get_address());
+        size_t size = region.get_size();
+        if (size < sizeof(GattCacheHeader)) {
+            return false;
+        }
+
+        GattCacheHeader header;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+                || header.version != kVersion
+                || header.address_type != link->address_type
+                || memcmp(header.address, link->address.addr, 6) != 0
+                || size < sizeof(header) + header.count * sizeof(GattAttribute)) {
+            return false;
+        }
+
+        link->attributes.resize(header.count);
+        if (header.count) {
+            memcpy(&link->attributes[0], base + sizeof(header),
+                   header.count * sizeof(GattAttribute));
+        }
+        for (size_t i = 0; i < link->attributes.size(); i++) {
+            if (uint16 handle = ServiceChangedHandle(link->attributes[i])) {
+                link->service_changed_handle = handle;
+            }
+        }
+    } catch(const bip::interprocess_exception&) {
+        // no entry for this device yet
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @return  value handle of the Service Changed characteristic if that is
+ *          what the attribute describes, else 0
+ */
+uint16 GattCache::ServiceChangedHandle(const GattAttribute& attribute) {
+    uint8 service_changed[] = GATT_SERVICE_CHANGED_UUID;
+    if (attribute.uuid_len != 2 || memcmp(attribute.uuid, service_changed, 2) != 0) {
+        return 0;
+    }
+    // discovery records characteristics by declaration, with the value
+    // handle in end; a full handle walk records the value handle itself
+    if (attribute.kind == kGattCharacteristic) {
+        return attribute.end;
+    }
+    return attribute.kind == kGattAttribute ? attribute.handle : 0;
+}
+
+
+/**
+ * @return  true if the connected device's GATT layout came from the cache
+ */
+bool GattCache::IsHit(uint8 connection) {
+    return connection < APP_MAX_CONNECTIONS && links_[connection].hit;
+}
+
+
+/**
+ * @return  attributes of the connection, cached or recorded so far
+ */
+const std::vector<GattAttribute>* GattCache::Attributes(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return nullptr;
+    }
+    return &links_[connection].attributes;
+}
+
+
+/**
+ * @brief writes the attributes recorded on a connection to its cache file
+ * @return  true on success
+ */
+bool GattCache::Store(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS || !links_[connection].connected) {
+        return false;
+    }
+    Link& link = links_[connection];
+
+    std::sort(link.attributes.begin(), link.attributes.end(),
+              [](const GattAttribute& a, const GattAttribute& b) {
+                  return a.handle != b.handle ? a.handle < b.handle : a.kind < b.kind;
+              });
+
+    GattCacheHeader header = GattCacheHeader();
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.address_type = link.address_type;
+    header.count = link.attributes.size();
+    memcpy(header.address, link.address.addr, 6);
+
+    // write a temporary file first so a reader never maps half an entry
+    std::string path = FileName(link.address, link.address_type);
+    std::string tmp = path + ".tmp";
+
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (ok && header.count) {
+        ok = fwrite(&link.attributes[0], sizeof(GattAttribute), header.count, f)
+                == header.count;
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    remove(path.c_str());
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief drops the cached layout of a connection's device
+ */
+void GattCache::Invalidate(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS || !links_[connection].connected) {
+        return;
+    }
+    Link& link = links_[connection];
+
+    printf("[#] GATT cache invalidated for connection %d\n", connection);
+    remove(FileName(link.address, link.address_type).c_str());
+    link.hit = false;
+    link.service_changed_handle = 0;
+    link.attributes.clear();
+}
+
+
+/**
+ * @brief adds or replaces an attribute of a connection without cache hit
+ */
+void GattCache::Record(uint8 connection, const GattAttribute& attribute) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    Link& link = links_[connection];
+    if (!link.connected || link.hit) {
+        return;
+    }
+
+    if (uint16 handle = ServiceChangedHandle(attribute)) {
+        link.service_changed_handle = handle;
+    }
+
+    for (size_t i = 0; i < link.attributes.size(); i++) {
+        if (link.attributes[i].handle == attribute.handle
+                && link.attributes[i].kind == attribute.kind) {
+            link.attributes[i] = attribute;
+            return;
+        }
+    }
+    link.attributes.push_back(attribute);
+}
+
+
+/**
+ * @brief loads the cache entry when a device connects
+ */
+void GattCache::OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+
+    if (!(msg->flags & connection_connected)) {
+        return;
+    }
+
+    // parameter updates of a known link
+    if (link.connected && memcmp(link.address.addr, msg->address.addr, 6) == 0) {
+        return;
+    }
+
+    link.connected = true;
+    link.address = msg->address;
+    link.address_type = msg->address_type;
+    link.service_changed_handle = 0;
+    link.attributes.clear();
+    link.hit = Load(&link);
+
+    if (link.hit) {
+        printf("[#] GATT cache hit, %d attributes\n",
+               static_cast<int>(link.attributes.size()));
+    }
+}
+
+
+/**
+ * @brief forgets the state of a connection
+ */
+void GattCache::OnDisconnected(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    links_[connection].connected = false;
+    links_[connection].hit = false;
+    links_[connection].attributes.clear();
+}
+
+
+void GattCache::OnGroupFound(const struct ble_msg_attclient_group_found_evt_t* msg) {
+    GattAttribute a = GattAttribute();
+    a.handle = msg->start;
+    a.end = msg->end;
+    a.kind = kGattService;
+    a.uuid_len = std::min<uint8>(msg->uuid.len, sizeof(a.uuid));
+    memcpy(a.uuid, msg->uuid.data, a.uuid_len);
+    Record(msg->connection, a);
+}
+
+
+void GattCache::OnInformationFound(const struct ble_msg_attclient_find_information_found_evt_t* msg) {
+    GattAttribute a = GattAttribute();
+    a.handle = msg->chrhandle;
+    a.kind = kGattAttribute;
+    a.uuid_len = std::min<uint8>(msg->uuid.len, sizeof(a.uuid));
+    memcpy(a.uuid, msg->uuid.data, a.uuid_len);
+    Record(msg->connection, a);
+}
+
+
+void GattCache::OnAttributeFound(const struct ble_msg_attclient_attribute_found_evt_t* msg) {
+    GattAttribute a = GattAttribute();
+    a.handle = msg->chrdecl;
+    a.end = msg->value;
+    a.kind = kGattCharacteristic;
+    a.properties = msg->properties;
+    a.uuid_len = std::min<uint8>(msg->uuid.len, sizeof(a.uuid));
+    memcpy(a.uuid, msg->uuid.data, a.uuid_len);
+    Record(msg->connection, a);
+}
+
+
+/**
+ * @brief watches for indications of the Service Changed characteristic
+ */
+void GattCache::OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    const Link& link = links_[msg->connection];
+
+    if (link.service_changed_handle
+            && msg->atthandle == link.service_changed_handle
+            && (msg->type == ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE
+                || msg->type == ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE_RSP_REQ)) {
+        Invalidate(msg->connection);
+    }
+}
+
+
+/**
+ * @brief a handle that is not there means the cached layout is stale
+ */
+void GattCache::OnProcedureCompleted(uint8 connection, uint16 result) {
+    if (result == kResultInvalidHandle && IsHit(connection)) {
+        Invalidate(connection);
+    }
+}
@@ -0,0 +1,194 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <time.h>
+
+#include <algorithm>
+
+#include "../inc/handlerstats.h"
+#include "../inc/steadyclock.h"
+
+
+HandlerStats::Counters HandlerStats::counters_[HandlerStats::kMaxMessages];
+std::atomic<uint32> HandlerStats::reset_requested_(0);
+std::atomic<uint32> HandlerStats::reset_applied_(0);
+uint64_t HandlerStats::report_interval_ns_ = 0;
+uint64_t HandlerStats::next_report_ns_     = 0;
+
+
+/**
+ * @return  CPU time of the calling thread in ns, wall time where the platform
+ *          has no per-thread clock
+ */
+uint64_t HandlerStats::Now() {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#else
+    return WallNow();
+#endif
+}
+
+
+/**
+ * @return  monotonic wall time in ns
+ */
+uint64_t HandlerStats::WallNow() {
+    return SteadyClock::Ns();
+}
+
+
+/**
+ * @brief accounts one handler call, reader thread only
+ * @param api_msg       message whose handler just returned
+ * @param bytes         payload length
+ * @param start_ns      Now() taken right before the handler was called
+ */
+void HandlerStats::Record(const struct ble_msg* api_msg, uint32 bytes,
+                          uint64_t start_ns) {
+    uint64_t elapsed = Now() - start_ns;
+
+    int msg_idx = static_cast<int>(api_msg - ble_get_msg(0));
+    if (msg_idx < 0 || msg_idx >= kMaxMessages) {
+        return;
+    }
+
+    uint32 generation = reset_requested_.load(std::memory_order_acquire);
+    if (generation != reset_applied_.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < kMaxMessages; i++) {
+            counters_[i].calls.store(0, std::memory_order_relaxed);
+            counters_[i].total_ns.store(0, std::memory_order_relaxed);
+            counters_[i].max_ns.store(0, std::memory_order_relaxed);
+            counters_[i].bytes.store(0, std::memory_order_relaxed);
+        }
+        reset_applied_.store(generation, std::memory_order_release);
+    }
+
+    // single writer: plain load/store instead of read-modify-write
+    Counters& c = counters_[msg_idx];
+    c.calls.store(c.calls.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    c.total_ns.store(c.total_ns.load(std::memory_order_relaxed) + elapsed,
+                     std::memory_order_relaxed);
+    c.bytes.store(c.bytes.load(std::memory_order_relaxed) + bytes,
+                  std::memory_order_relaxed);
+    if (elapsed > c.max_ns.load(std::memory_order_relaxed)) {
+        c.max_ns.store(elapsed, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * @return  counters of all message types seen so far, most expensive first;
+ *          none while a reset is pending
+ */
+std::vector<HandlerStatsEntry> HandlerStats::Snapshot() {
+    std::vector<HandlerStatsEntry> entries;
+    if (reset_requested_.load(std::memory_order_acquire)
+            != reset_applied_.load(std::memory_order_acquire)) {
+        return entries;
+    }
+
+    for (int i = 0; i < kMaxMessages; i++) {
+        const Counters& c = counters_[i];
+        HandlerStatsEntry e;
+        e.calls = c.calls.load(std::memory_order_relaxed);
+        if (!e.calls) {
+            continue;
+        }
+        e.msg_idx  = i;
+        e.hdr      = ble_get_msg(i)->hdr;
+        e.total_ns = c.total_ns.load(std::memory_order_relaxed);
+        e.max_ns   = c.max_ns.load(std::memory_order_relaxed);
+        e.bytes    = c.bytes.load(std::memory_order_relaxed);
+        entries.push_back(e);
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const HandlerStatsEntry& a, const HandlerStatsEntry& b) {
+                  return a.total_ns > b.total_ns;
+              });
+    return entries;
+}
+
+
+/**
+ * @brief prints a snapshot as table
+ */
+void HandlerStats::Print(FILE* out) {
+    std::vector<HandlerStatsEntry> entries = Snapshot();
+
+    fprintf(out, "[#] handler stats: idx  type cls cmd      calls   total(us)"
+                 "  mean(us)   max(us)     bytes\n");
+    for (size_t i = 0; i < entries.size(); i++) {
+        const HandlerStatsEntry& e = entries[i];
+        fprintf(out, "                   %3d  %s  %3d %3d %10llu %11.1f %9.2f %9.1f %9llu\n",
+                e.msg_idx,
+                (e.hdr.type_hilen & 0x80) ? "evt" : "rsp",
+                e.hdr.cls, e.hdr.command,
+                static_cast<unsigned long long>(e.calls),
+                e.total_ns / 1000.0,
+                e.total_ns / 1000.0 / e.calls,
+                e.max_ns / 1000.0,
+                static_cast<unsigned long long>(e.bytes));
+    }
+}
+
+
+/**
+ * @brief clears all counters, from any thread; the reader does it before it
+ *        records the next message
+ */
+void HandlerStats::Reset() {
+    reset_requested_++;
+}
+
+
+/**
+ * @brief enables the periodic report printed by MaybeReport()
+ * @param seconds   interval, 0 disables the report
+ */
+void HandlerStats::SetReportInterval(uint32 seconds) {
+    report_interval_ns_ = seconds * 1000000000ULL;
+    next_report_ns_ = WallNow() + report_interval_ns_;
+}
+
+
+/**
+ * @brief prints the stats to stdout if the report interval has passed
+ */
+void HandlerStats::MaybeReport() {
+    if (!report_interval_ns_) {
+        return;
+    }
+
+    uint64_t now = WallNow();
+    if (now < next_report_ns_) {
+        return;
+    }
+    next_report_ns_ = now + report_interval_ns_;
+    Print(stdout);
+}
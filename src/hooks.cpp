@@ -0,0 +1,194 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include "../inc/hooks.h"
+#include "../inc/attscheduler.h"
+#include "../inc/attributedb.h"
+#include "../inc/channelmap.h"
+#include "../inc/connectionmanager.h"
+#include "../inc/connectiontuner.h"
+#include "../inc/discovery.h"
+#include "../inc/fleetsweep.h"
+#include "../inc/gattcache.h"
+#include "../inc/indications.h"
+#include "../inc/longattribute.h"
+#include "../inc/notificationring.h"
+#include "../inc/readaggregator.h"
+#include "../inc/rssisampler.h"
+#include "../inc/scanner.h"
+#include "../inc/scanscheduler.h"
+#include "../inc/streamops.h"
+#include "../inc/subscriptions.h"
+#include "../inc/writestream.h"
+
+
+void hook_rsp_attclient(uint8 connection, uint16 result) {
+    AttScheduler::OnResponse(connection, result);
+}
+
+
+/**
+ * @return  non-zero if the response belongs to a command AttScheduler sent,
+ *          the caller must leave the application's flags alone then
+ */
+int hook_rsp_command(uint16 result) {
+    return AttScheduler::OnCommandResponse(result);
+}
+
+
+void hook_rsp_attclient_indicate_confirm(uint16 result) {
+    IndicationConfirmer::OnConfirmResponse(result);
+}
+
+
+/**
+ * @brief for the responses of ble_cmd_connection_* commands that are
+ *        queued per link
+ */
+void hook_rsp_connection(uint8 connection, uint16 result) {
+    AttScheduler::OnResponse(connection, result);
+}
+
+
+void hook_rsp_connection_get_rssi(uint8 connection, int8 rssi) {
+    // the response carries no result code, a sample means success
+    RssiSampler::OnRssi(connection, rssi);
+    AttScheduler::OnResponse(connection, 0);
+}
+
+
+void hook_rsp_connection_channel_map_get(const struct ble_msg_connection_channel_map_get_rsp_t *msg) {
+    ChannelMapManager::OnMapRead(msg);
+    AttScheduler::OnResponse(msg->connection, 0);
+}
+
+
+void hook_rsp_system_get_counters(const struct ble_msg_system_get_counters_rsp_t *msg) {
+    ChannelMapManager::OnCounters(msg);
+    AttScheduler::OnCommandResponse(0);
+}
+
+
+/**
+ * @brief a status for a link that is down changes nothing, links end with
+ *        hook_evt_connection_disconnected() only
+ */
+void hook_evt_connection_status(const struct ble_msg_connection_status_evt_t *msg) {
+    if (msg->flags & connection_connected) {
+        AttScheduler::OnConnected(msg->connection);
+    }
+    GattCache::OnConnectionStatus(msg);
+    SubscriptionManager::OnConnectionStatus(msg);
+    ScanScheduler::OnConnectionStatus(msg);
+    ConnectionManager::OnConnectionStatus(msg);
+    ConnectionTuner::OnConnectionStatus(msg);
+    RssiSampler::OnConnectionStatus(msg);
+}
+
+
+void hook_evt_connection_disconnected(const struct ble_msg_connection_disconnected_evt_t *msg) {
+    // first, the reads failed below are not a device's answer
+    FleetSweep::OnDisconnected(msg->connection);
+    AttScheduler::OnDisconnected(msg->connection);
+    ReadAggregator::OnDisconnected(msg->connection);
+    WriteStream::OnDisconnected(msg->connection);
+    StreamOperators::OnDisconnected(msg->connection);
+    GattCache::OnDisconnected(msg->connection);
+    SubscriptionManager::OnDisconnected(msg->connection);
+    ScanScheduler::OnDisconnected(msg->connection);
+    ConnectionManager::OnDisconnected(msg->connection);
+    ConnectionTuner::OnDisconnected(msg->connection);
+    RssiSampler::OnDisconnected(msg->connection);
+    ChannelMapManager::OnDisconnected(msg->connection);
+    if (AttributeDb* db = AttributeDb::ForConnection(msg->connection)) {
+        db->Clear();
+    }
+}
+
+
+/**
+ * @return  1 if the procedure was one of the modules', not the application's
+ */
+int hook_evt_attclient_procedure_completed(const struct ble_msg_attclient_procedure_completed_evt_t *msg) {
+    // a packet of a write stream went out, no scheduled operation ends here
+    if (WriteStream::OnProcedureCompleted(msg)) {
+        return 1;
+    }
+    GattCache::OnProcedureCompleted(msg->connection, msg->result);
+    return AttScheduler::OnProcedureCompleted(msg->connection, msg->result);
+}
+
+
+void hook_evt_attclient_attribute_value(const struct ble_msg_attclient_attribute_value_evt_t *msg) {
+    // before anything else, the peer cannot indicate again until confirmed
+    IndicationConfirmer::OnAttributeValue(msg);
+    switch (msg->type) {
+    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_NOTIFY:
+    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE:
+    case ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE_RSP_REQ:
+        NotificationRing::Push(msg->connection, msg->type, msg->atthandle,
+                               msg->value.data, msg->value.len);
+        StreamOperators::OnValue(msg->connection, msg->atthandle,
+                                 msg->value.data, msg->value.len);
+        ConnectionTuner::OnNotification(msg->connection);
+        break;
+    default:
+        break;
+    }
+    ChannelMapManager::OnAttributeValue(msg->connection, msg->value.len);
+    GattCache::OnAttributeValue(msg);
+    Discovery::OnAttributeValue(msg);
+    ReadAggregator::OnAttributeValue(msg);
+    LongAttribute::OnAttributeValue(msg);
+    AttScheduler::OnAttributeValue(msg->connection, msg->type);
+}
+
+
+void hook_evt_attclient_group_found(const struct ble_msg_attclient_group_found_evt_t *msg) {
+    GattCache::OnGroupFound(msg);
+    Discovery::OnGroupFound(msg);
+}
+
+
+void hook_evt_attclient_find_information_found(const struct ble_msg_attclient_find_information_found_evt_t *msg) {
+    GattCache::OnInformationFound(msg);
+    Discovery::OnInformationFound(msg);
+}
+
+
+void hook_evt_attclient_attribute_found(const struct ble_msg_attclient_attribute_found_evt_t *msg) {
+    GattCache::OnAttributeFound(msg);
+}
+
+
+void hook_evt_attclient_read_multiple_response(const struct ble_msg_attclient_read_multiple_response_evt_t *msg) {
+    ReadAggregator::OnReadMultipleResponse(msg);
+    AttScheduler::OnReadMultipleResponse(msg->connection);
+}
+
+
+void hook_evt_gap_scan_response(const struct ble_msg_gap_scan_response_evt_t *msg) {
+    Scanner::OnScanResponse(msg);
+}
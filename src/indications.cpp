@@ -0,0 +1,99 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include "../inc/indications.h"
+#include "../inc/steadyclock.h"
+
+
+IndicationConfirmer::Pending IndicationConfirmer::pending_[APP_MAX_CONNECTIONS];
+uint8 IndicationConfirmer::head_ = 0;
+uint8 IndicationConfirmer::count_ = 0;
+IndicationStats IndicationConfirmer::stats_[APP_MAX_CONNECTIONS];
+
+
+/**
+ * @brief confirms the value right away if the peer asked for it; to be
+ *        called first for every ble_evt_attclient_attribute_value
+ */
+void IndicationConfirmer::OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg) {
+    if (msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE_RSP_REQ
+            || msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    // the handler runs this first, so it is about when the event was read;
+    // sending the confirm is part of what is measured
+    uint64_t now = SteadyClock::Us();
+
+    ble_cmd_attclient_indicate_confirm(msg->connection);
+    stats_[msg->connection].indications++;
+
+    // a peer that does not wait for us must not overrun the table
+    if (count_ == APP_MAX_CONNECTIONS) {
+        head_ = (head_ + 1) % APP_MAX_CONNECTIONS;
+        count_--;
+    }
+    Pending& p = pending_[(head_ + count_) % APP_MAX_CONNECTIONS];
+    p.connection = msg->connection;
+    p.time_us = now;
+    count_++;
+}
+
+
+/**
+ * @brief to be called for every ble_rsp_attclient_indicate_confirm
+ */
+void IndicationConfirmer::OnConfirmResponse(uint16 result) {
+    if (!count_) {
+        return;
+    }
+    const Pending& p = pending_[head_];
+    head_ = (head_ + 1) % APP_MAX_CONNECTIONS;
+    count_--;
+
+    IndicationStats& stats = stats_[p.connection];
+    if (result) {
+        stats.failed++;
+        return;
+    }
+
+    uint32 latency = static_cast<uint32>(SteadyClock::Us() - p.time_us);
+    if (!stats.confirmed || latency < stats.latency_min_us) {
+        stats.latency_min_us = latency;
+    }
+    if (latency > stats.latency_max_us) {
+        stats.latency_max_us = latency;
+    }
+    stats.latency_sum_us += latency;
+    stats.confirmed++;
+}
+
+
+IndicationStats IndicationConfirmer::Stats(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return IndicationStats();
+    }
+    return stats_[connection];
+}
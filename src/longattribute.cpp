@@ -0,0 +1,172 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include "../inc/longattribute.h"
+#include "../inc/attscheduler.h"
+
+
+LongAttribute::Link LongAttribute::links_[APP_MAX_CONNECTIONS];
+
+
+/**
+ * @brief reads a value of any length
+ * @param connection    connection handle
+ * @param handle        attribute handle
+ * @param done          called once with the result and the whole value
+ */
+void LongAttribute::Read(uint8 connection, uint16 handle, const long_read_done& done) {
+    AttOp op = AttOp();
+    op.priority = kAttPriorityNormal;
+    op.completion = kAttCompletesOnProcedure;
+    op.issue = [handle](uint8 c) {
+        links_[c].reading = handle;
+        links_[c].value = std::make_shared<ChainBuffer>();
+        ble_cmd_attclient_read_long(c, handle);
+    };
+    op.done = [connection, done](uint16 result) {
+        chain_buffer_ptr value;
+        if (connection < APP_MAX_CONNECTIONS) {
+            value.swap(links_[connection].value);
+            links_[connection].reading = 0;
+        }
+        if (result || !value) {
+            value = std::make_shared<ChainBuffer>();
+        }
+        if (done) {
+            done(result, value);
+        }
+    };
+
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief writes a value of any length with queued (prepared) writes
+ * @param connection    connection handle
+ * @param handle        attribute handle
+ * @param value         the value, must not change until done is called
+ * @param done          called once the value is committed or failed
+ */
+void LongAttribute::Write(uint8 connection, uint16 handle, const chain_buffer_ptr& value,
+                          const long_write_done& done) {
+    std::shared_ptr<PendingWrite> write = std::make_shared<PendingWrite>();
+    write->connection = connection;
+    write->handle = handle;
+    write->offset = 0;
+    write->result = 0;
+    write->value = value;
+    write->done = done;
+
+    PrepareNext(write);
+}
+
+
+/**
+ * @brief like above, copies data into a ChainBuffer first
+ */
+void LongAttribute::Write(uint8 connection, uint16 handle, const uint8* data, size_t len,
+                          const long_write_done& done) {
+    chain_buffer_ptr value = std::make_shared<ChainBuffer>();
+    value->Append(data, len);
+    Write(connection, handle, value, done);
+}
+
+
+/**
+ * @brief queues the next prepare_write, or the execute_write after the last
+ */
+void LongAttribute::PrepareNext(const std::shared_ptr<PendingWrite>& write) {
+    if (write->offset >= write->value->Size()) {
+        Execute(write, 1);
+        return;
+    }
+
+    uint32 offset = write->offset;
+    size_t left = write->value->Size() - offset;
+    uint8 len = left < kPrepareWriteChunk ? left : kPrepareWriteChunk;
+
+    AttOp op = AttOp();
+    op.priority = kAttPriorityNormal;
+    op.completion = kAttCompletesOnProcedure;
+    op.issue = [write, offset, len](uint8 c) {
+        uint8 chunk[kPrepareWriteChunk];
+        write->value->CopyOut(offset, chunk, len);
+        ble_cmd_attclient_prepare_write(c, write->handle, offset, len, chunk);
+    };
+    op.done = [write, len](uint16 result) {
+        if (result == AttScheduler::kResultNotConnected) {
+            // nothing left to cancel on a link that is gone
+            if (write->done) {
+                write->done(result);
+            }
+        } else if (result) {
+            write->result = result;
+            Execute(write, 0);
+        } else {
+            write->offset += len;
+            PrepareNext(write);
+        }
+    };
+
+    AttScheduler::Submit(write->connection, op);
+}
+
+
+/**
+ * @brief commits (1) or cancels (0) the prepared writes
+ */
+void LongAttribute::Execute(const std::shared_ptr<PendingWrite>& write, uint8 commit) {
+    AttOp op = AttOp();
+    op.priority = kAttPriorityNormal;
+    op.completion = kAttCompletesOnProcedure;
+    op.issue = [commit](uint8 c) {
+        ble_cmd_attclient_execute_write(c, commit);
+    };
+    op.done = [write](uint16 result) {
+        if (write->done) {
+            write->done(write->result ? write->result : result);
+        }
+    };
+
+    AttScheduler::Submit(write->connection, op);
+}
+
+
+/**
+ * @brief appends the fragments of a running read_long
+ */
+void LongAttribute::OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    if (!link.reading || !link.value || msg->atthandle != link.reading
+            || (msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_READ
+                && msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_READ_BLOB)) {
+        return;
+    }
+    link.value->Append(msg->value.data, msg->value.len);
+}
@@ -26,11 +26,35 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
 #include <cstddef>
 
 #include "./inc/simpleserial.h"
 #include "./inc/config.h"
 #include "./inc/utils.h"
+#include "./inc/txqueue.h"
+#include "./inc/handlerstats.h"
+#include "./inc/gattcache.h"
+#include "./inc/indications.h"
+#include "./inc/advertisingdata.h"
+#include "./inc/attributedb.h"
+#include "./inc/attscheduler.h"
+#include "./inc/channelmap.h"
+#include "./inc/connectionmanager.h"
+#include "./inc/connectiontuner.h"
+#include "./inc/discovery.h"
+#include "./inc/eventexecutor.h"
+#include "./inc/fleetsweep.h"
+#include "./inc/readaggregator.h"
+#include "./inc/rssisampler.h"
+#include "./inc/scanner.h"
+#include "./inc/scanscheduler.h"
+#include "./inc/notificationring.h"
+#include "./inc/payloadschema.h"
+#include "./inc/streamops.h"
+#include "./inc/timeseries.h"
+#include "./inc/subscriptions.h"
+#include "./inc/writestream.h"
 
 
 
@@ -53,6 +77,14 @@ uint16_t app_state;
 // For message flow
 int8 wait_for_rsp();
 int8 wait_for_evt();
+int8 wait_for_idle();
+
+// Periodic wake-up
+void start_ticker();
+void stop_ticker();
+
+// Batch mode
+void sweep(const char* list, int count, char* uuids[]);
 
 // Misc
 void solveThisIssue();
@@ -61,6 +93,7 @@ void die();
 
 void print_help() {
     printf("\tUsage: BL_T0003 COM-port\n");
+    printf("\t       BL_T0003 COM-port sweep device-list UUID...\n");
 }
 
 
@@ -95,8 +128,10 @@ int main(int argc, char* argv[]) {
                 bio_spb::stop_bits::one,            // one stop bit
                 bio_spb::flow_control::hardware);   // hardware flow control
 
-        // tell the bluegiga library which function to use for serial output
-        bglib_output = SimpleSerial::WriteBleMessage;
+        // tell the bluegiga library which function to use for serial output,
+        // commands are queued so that any thread may send them
+        TxQueue::Start(SimpleSerial::WriteRaw);
+        bglib_output = TxQueue::Submit;
 
 
         // Target MAC address
@@ -114,6 +149,19 @@ int main(int argc, char* argv[]) {
         app_connection.timeout = 1000;              // 10s
         app_connection.latency = 0;                 // 0ms
 
+        // Discovered services and handles are kept here between runs
+        GattCache::SetDirectory(".gattcache");
+
+        // Notifications and indications go to a ring, they come in bursts
+        NotificationRing::Init(NotificationRing::kDefaultCapacity, kDropOldest);
+
+        // ... and every one of them is kept on disk, per device and handle,
+        // see below
+        TimeSeries::SetDirectory(".timeseries");
+
+        // Where the time of the message handlers goes, printed every minute
+        HandlerStats::SetReportInterval(60);
+
         // Provide place to store data
         app_attclient.value.data = value_buffer;
         app_attclient.value.len = 0;
@@ -139,19 +187,109 @@ int main(int argc, char* argv[]) {
         }
         // No need to wait for an event here
 
-        // Connect to target with specific settings
-        printf("[###]Connect to target[###]\n");
-        printf("[>] ble_cmd_gap_connect_direct\n");
-        ble_cmd_gap_connect_direct(app_connection.target.addr,
-                                   app_connection.addr_type,
-                                   app_connection.conn_interval_min,
-                                   app_connection.conn_interval_max,
-                                   app_connection.timeout,
-                                   app_connection.latency);
-        if (wait_for_rsp() != APP_OK) {
+        // The loops below poll modules and check deadlines after each
+        // message, a soft timer makes sure one comes when the radio is quiet
+        start_ticker();
+
+        // Batch mode: read the given characteristics from every device of
+        // the list instead of the walk through one device below
+        if (argc >= 4 && !strcmp(argv[2], "sweep")) {
+            sweep(argv[3], argc - 4, argv + 4);
+            HandlerStats::Print(stdout);
+            stop_ticker();
+            TxQueue::Flush();
+            exit(0);
+        }
+
+        // Storing notifications is done by the worker pool, off the thread
+        // that reads the UART; notifications of one connection stay in order
+        EventExecutor::Subscribe(ble_evt_attclient_attribute_value_idx,
+                                 [target](const void* payload) {
+            const struct ble_msg_attclient_attribute_value_evt_t* msg =
+                    static_cast<const struct ble_msg_attclient_attribute_value_evt_t*>(payload);
+            if (msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_NOTIFY
+                    && msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE
+                    && msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_INDICATE_RSP_REQ) {
+                return;
+            }
+            uint64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+            TimeSeries::Append(target, msg->atthandle, now_us, msg->value.data, msg->value.len);
+        });
+        EventExecutor::Start(0);
+
+        // Look around first, the target has to advertise anyway. Scan until
+        // it shows up, for a few seconds at most, with the duty cycle
+        // planned to find every advertiser within that time.
+        printf("[###]Scan for advertisers[###]\n");
+        printf("[>] ble_cmd_gap_discover\n");
+        Scanner::Init(Scanner::kDefaultCapacity);
+        // Only Bluegiga modules are of interest, the target is one of them
+        uint8 bluegiga_oui[] = { 0x00, 0x07, 0x80 };
+        Scanner::SetFilter(ScanFilter().AddressPrefix(bluegiga_oui, sizeof(bluegiga_oui)));
+        ScanSchedulerConfig scan_config = ScanSchedulerConfig::Default();
+        scan_config.target_latency_ms = 3000;
+        ScanScheduler::Start(scan_config);
+        ScanDevice seen;
+        std::chrono::steady_clock::time_point scan_end =
+                std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        while (!Scanner::Find(app_connection.target, app_connection.addr_type, &seen)
+               && std::chrono::steady_clock::now() < scan_end) {
+            if (SimpleSerial::ReadBleMessage()) {
+                die();
+            }
+            ScanScheduler::Poll();
+        }
+        printf("[>] ble_cmd_gap_end_procedure\n");
+        ScanScheduler::Stop();
+        // the scan commands are not ours to wait for, but the procedure has
+        // to be over before connecting
+        if (wait_for_idle() != APP_OK) {
             die();
         }
-        wait_for_evt();
+        ScannerStats scan = Scanner::Stats();
+        printf("[#] Scan: %llu advertisements, %llu filtered, from %lu devices\n",
+               static_cast<unsigned long long>(scan.advertisements),
+               static_cast<unsigned long long>(scan.filtered), scan.devices);
+        ScanSchedulerStats scan_plan = ScanScheduler::Stats();
+        printf("[#] Scan schedule: %u%% duty, advertising every ~%lums, %lu active bursts\n",
+               scan_plan.duty, scan_plan.advertising_interval_ms, scan_plan.bursts);
+        if (Scanner::Find(app_connection.target, app_connection.addr_type, &seen)) {
+            printf("[#] Target seen %lu times, RSSI %d dBm (%d..%d)\n", seen.count,
+                   static_cast<int>(seen.rssi_sum / static_cast<int64_t>(seen.count)),
+                   seen.rssi_min, seen.rssi_max);
+            AdvertisingData advertised(seen.data, seen.data_len);
+            const char* name;
+            uint8 name_len;
+            bool complete;
+            if (advertised.LocalName(&name, &name_len, &complete)) {
+                printf("[#] Target calls itself \"%.*s\"%s\n", name_len, name,
+                       complete ? "" : "...");
+            }
+        }
+
+        // Connect to target with specific settings. The connection manager
+        // keeps it in the whitelist and connects selectively whenever it
+        // advertises, should the link drop it comes back after a backoff.
+        printf("[###]Connect to target[###]\n");
+        ConnectionParameters parameters = { app_connection.conn_interval_min,
+                                            app_connection.conn_interval_max,
+                                            app_connection.timeout,
+                                            app_connection.latency };
+        ConnectionManager::SetParameters(parameters);
+        ConnectionManager::AddTarget(app_connection.target, app_connection.addr_type);
+        ConnectionManager::Start();
+        std::chrono::steady_clock::time_point connect_end =
+                std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        ConnectionManager::Poll();
+        while (!ConnectionManager::IsConnected(app_connection.target,
+                                               app_connection.addr_type, NULL)
+               && std::chrono::steady_clock::now() < connect_end) {
+            if (SimpleSerial::ReadBleMessage()) {
+                die();
+            }
+            ConnectionManager::Poll();
+        }
 
         // Are we connected?
         if (app_connection.state != APP_DEVICE_CONNECTED) {
@@ -163,28 +301,70 @@ int main(int argc, char* argv[]) {
         uint16 handle_start = 0x0001;
         uint16 handle_end = 0xFFFF;
 
-        // Give me all informations you can get
-        printf("[###]Find Informations[###]\n");
-        printf("[>] ble_cmd_attclient_find_information\n");
-        ble_cmd_attclient_find_information(app_connection.handle, handle_start,
-                                           handle_end);
-        if (wait_for_rsp() != APP_OK) {
-            die();
+        // Nothing to discover if we have seen this device before
+        if (GattCache::IsHit(app_connection.handle)) {
+            printf("[###]Services and handles taken from cache[###]\n");
+        } else {
+            // Services, then the characteristic declarations per service,
+            // then only the handles where descriptors can be
+            printf("[###]Discover services and characteristics[###]\n");
+            uint16 discovery_result = 0;
+            Discovery::Start(app_connection.handle,
+                             [&discovery_result](uint16 result, const DiscoveryStats&) {
+                                 discovery_result = result;
+                             });
+            while (Discovery::IsRunning(app_connection.handle)) {
+                if (SimpleSerial::ReadBleMessage()) {
+                    die();
+                }
+            }
+            if (discovery_result) {
+                printf("[#] Discovery failed: 0x%04x\n", discovery_result);
+                die();
+            }
         }
-        wait_for_evt();
 
-        // Give me all primary services within the whole handle range
-        // Hint: With handle start and handle end groups can be separated
-        uint8 uuid[] = GATT_PRIMARY_SERVICE_UUID;
-        uint8 uuid_len = sizeof(uuid);
-        printf("[>] ble_cmd_attclient_read_by_group_type\n");
-        ble_cmd_attclient_read_by_group_type(app_connection.handle,
-                                             handle_start,
-                                             handle_end, uuid_len, uuid);
-        if (wait_for_rsp() != APP_OK) {
-            die();
+        // Index what we know about the target, from now on handles are
+        // looked up by UUID
+        AttributeDb* db = AttributeDb::ForConnection(app_connection.handle);
+        if (db->Empty()) {
+            db->Build(*GattCache::Attributes(app_connection.handle));
         }
-        wait_for_evt();
+        printf("[#] Attribute database, %d entries:\n",
+               static_cast<int>(db->Size()));
+        db->Print();
+
+        // The BGDemo characteristic we write to and read from, 128-bit UUID
+        uint8 bgdemo_char_uuid[16] = {0};
+        uint8 bgdemo_char_uuid_len = sizeof(bgdemo_char_uuid);
+        // String representation of uuid
+        char str_uuid[] = "f1b41cde-dbf5-4acf-8679-ecb8b4dca6fe";
+        // Convert string uuid to uint8 array
+        uuid128StrToArray(str_uuid, bgdemo_char_uuid);
+        // Reverse address to network format
+        reverseArray(bgdemo_char_uuid, bgdemo_char_uuid_len);
+
+        // The custom battery characteristic that sends notifications. BLEGUI
+        // shows its value at handle 16 for the BGDemo firmware, its UUID is
+        // whatever the database has for that handle. If discovery did not
+        // turn it up, the schema is kept under the nil UUID.
+        uint16 battery_value_handle = 16;
+        uint8 battery_char_uuid[16] = {0};
+        uint8 battery_char_uuid_len = sizeof(battery_char_uuid);
+        bool battery_known = false;
+        const AttEntry* battery_entry = db->FindByHandle(battery_value_handle);
+        if (battery_entry && battery_entry->type == kAttCharacteristicValue) {
+            memcpy(battery_char_uuid, battery_entry->uuid.bytes, sizeof(battery_char_uuid));
+            battery_known = true;
+        }
+        // Its value is the battery voltage in 10th of a millivolt, an unsigned
+        // 16-bit one in little endian
+        PayloadField battery_voltage = { "voltage", 0, kFieldUint16, kLittleEndian,
+                                         0.0001, 0.0 };
+        PayloadSchema::Register(battery_char_uuid, battery_char_uuid_len,
+                                std::vector<PayloadField>(1, battery_voltage));
+        const PayloadSchema* battery_schema =
+                PayloadSchema::ForUuid(battery_char_uuid, battery_char_uuid_len);
 
         // Now lets get us some values with an UUID i.e. the device name
         uint8 devicename_uuid[] = GATT_DEVICENAME_UUID;
@@ -216,8 +396,13 @@ int main(int argc, char* argv[]) {
             die();
         }
 
-        // Write a value with a handle
-        uint8 bgdemo_handle = 20;
+        // Write a value with a handle. Handle 20 is what BLEGUI shows for the
+        // BGDemo firmware, only used if the characteristic was not discovered.
+        uint16 bgdemo_handle = db->ValueHandle(bgdemo_char_uuid,
+                                               bgdemo_char_uuid_len);
+        if (!bgdemo_handle) {
+            bgdemo_handle = 20;
+        }
         uint8 bgdemo_value[] = {0x12, 0x34, 0x56};
         uint8 bgdemo_value_len = sizeof(bgdemo_value);
 
@@ -231,15 +416,6 @@ int main(int argc, char* argv[]) {
         wait_for_evt();
 
         // Read value with 128-bit UUID
-        uint8 bgdemo_char_uuid[16] = {0};
-        uint8 bgdemo_char_uuid_len = sizeof(bgdemo_char_uuid);
-        // String representation of uuid
-        char str_uuid[] = "f1b41cde-dbf5-4acf-8679-ecb8b4dca6fe";
-        // Convert string uuid to uint8 array
-        uuid128StrToArray(str_uuid, bgdemo_char_uuid);
-        // Reverse address to network format
-        reverseArray(bgdemo_char_uuid, bgdemo_char_uuid_len);
-
         printf("[###]Read a value by 128bit UUID[###]\n");
         printf("[>] ble_cmd_attclient_read_by_type\n");
         ble_cmd_attclient_read_by_type(app_connection.handle, handle_start,
@@ -264,26 +440,99 @@ int main(int argc, char* argv[]) {
             die();
         }
 
-        // The data is simply an unsigned 16-bit one in network format,
-        // this value will enable the notification
-        uint8 serv_conf_enable[2] = { 0x01, 0x00 };
-        uint8 serv_conf_len = sizeof(serv_conf_enable);
-        uint8 serv_conf_handle = 17;
-        uint8 serv_notification_handle = 16;
+        // Values of known length are read together, appearance and battery
+        // voltage cost a single ATT round trip. read_multiple splits the
+        // values by these lengths: the appearance is 2 bytes by the spec,
+        // the voltage as long as its schema says.
+        uint8 appearance_uuid[] = GATT_APPEARANCE_UUID;
+        uint16 appearance_handle = db->ValueHandle(appearance_uuid,
+                                                   sizeof(appearance_uuid));
+        uint16 battery_handle = battery_known ? battery_value_handle : 0;
+        if (appearance_handle && battery_handle) {
+            printf("[###]Read appearance and battery voltage at once[###]\n");
+            int reads = 2;
+            ReadAggregator::Read(app_connection.handle, appearance_handle, 2,
+                                 [&reads](uint16 result, const uint8* data, uint8) {
+                                     if (!result) {
+                                         printf("[#] Appearance: 0x%04x\n",
+                                                data[0] | (data[1] << 8));
+                                     }
+                                     reads--;
+                                 });
+            ReadAggregator::Read(app_connection.handle, battery_handle,
+                                 battery_schema->MinLength(),
+                                 [&reads, battery_schema](uint16 result, const uint8* data,
+                                                          uint8 len) {
+                                     double voltage;
+                                     if (!result && battery_schema->Decode(data, len, &voltage)) {
+                                         printf("[#] Battery Voltage: %1.3f Volt\n", voltage);
+                                     }
+                                     reads--;
+                                 });
+            ReadAggregator::Flush(app_connection.handle);
+            while (reads) {
+                if (SimpleSerial::ReadBleMessage()) {
+                    die();
+                }
+            }
+        }
 
-        // Write the data to a handle we already looked up with BLEGUI. It is
-        // the handle of the GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_UUID
-        // related to the custom battery service. This handle is valid for
-        // the BGDemo example.
-        printf("[###]Activate Service Notification by handle[###]\n");
-        printf("[>] ble_cmd_attclient_attribute_write\n");
-        ble_cmd_attclient_attribute_write(app_connection.handle,
-                                          serv_conf_handle, serv_conf_len,
-                                          serv_conf_enable);
-        if (wait_for_rsp() != APP_OK) {
-            die();
+        // Enable notifications of the custom battery characteristic through
+        // its GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_UUID descriptor. The
+        // subscription is remembered and written again on reconnect.
+        uint16 serv_notification_handle = battery_known ? battery_value_handle : 0;
+        uint32 subscribed = 0;
+        printf("[###]Activate Service Notification[###]\n");
+        if (battery_known) {
+            SubscriptionManager::Subscribe(app_connection.target, battery_char_uuid,
+                                           battery_char_uuid_len, kSubscribeNotify);
+        }
+        SubscriptionManager::Apply(app_connection.handle,
+                                   [&subscribed](uint16 result, uint32 written, uint32) {
+                                       if (!result) {
+                                           subscribed = written;
+                                       }
+                                   });
+        while (SubscriptionManager::IsApplying(app_connection.handle)) {
+            if (SimpleSerial::ReadBleMessage()) {
+                die();
+            }
+        }
+
+        // If discovery did not turn the descriptor up, fall back to the
+        // handles we looked up with BLEGUI, they are valid for the BGDemo
+        // example.
+        if (!subscribed || !serv_notification_handle) {
+            uint8 serv_conf_enable[2] = { kSubscribeNotify, 0x00 };
+            uint16 serv_conf_handle = 17;
+            serv_notification_handle = battery_value_handle;
+            printf("[>] ble_cmd_attclient_attribute_write\n");
+            ble_cmd_attclient_attribute_write(app_connection.handle,
+                                              serv_conf_handle, sizeof(serv_conf_enable),
+                                              serv_conf_enable);
+            if (wait_for_rsp() != APP_OK) {
+                die();
+            }
+            wait_for_evt();
         }
-        wait_for_evt();
+
+        // Besides every single value, print one summary per second of those
+        // that changed by more than a millivolt
+        std::vector<StreamOp> battery_ops;
+        battery_ops.push_back(StreamOp::ChangeOnly(0.001));
+        battery_ops.push_back(StreamOp::Tumbling(1000000));
+        StreamOperators::Configure(app_connection.handle, serv_notification_handle,
+                                   battery_schema, 0, battery_ops,
+                                   [](uint8, uint16, const StreamSample& sample) {
+                                       printf("[#] Battery Voltage over %lu changes:"
+                                              " %1.3f/%1.3f/%1.3f Volt (min/mean/max)\n",
+                                              sample.count, sample.min, sample.value,
+                                              sample.max);
+                                   });
+
+        // Meanwhile find out whether some channels cost us retransmissions
+        ChannelMapManager::SetWindow(1000);
+        ChannelMapManager::Start(app_connection.handle, channel_map_done());
 
         // Get notified 10 times ...
         printf("[###]Watch for notifications and print them"
@@ -294,6 +543,8 @@ int main(int argc, char* argv[]) {
             // within the wait_for_... functions.
             if (SimpleSerial::ReadBleMessage()) {
                 printf("Error reading message\n");
+                stop_ticker();
+                TxQueue::Flush();
                 exit(-1);
             }
 
@@ -301,41 +552,105 @@ int main(int argc, char* argv[]) {
             if (issetFlag(app_state, APP_ATTCLIENT_ERROR)) {
                 die();
             };
-
-            // Check if a notification is pending and if yes check for the
-            // handle of the battery service we are looking for
-            if (issetFlag(app_state, APP_ATTCLIENT_NOTIFICATION_PENDING)) {
-                clearFlag(app_state, APP_ATTCLIENT_NOTIFICATION_PENDING);
-
-                // We already know the handle of the custom battery service by
-                // looking it up with BLEGUI earlier. Now lets see if it is the
-                // handle we've waited for.
-                if (app_attclient.handle == serv_notification_handle) {
-                    // The service characteristics value is simply the battery
-                    // voltage in 10th of a millivolt. First put the 16-bit
-                    // value together and then convert the value to volts.
-                    uint16 voltage = (app_attclient.value.data[1] << 8)
-                            | app_attclient.value.data[0];
-                    printf("[#] Notification %d - Battery Voltage:"
-                           " %1.3f Volt\n", notifications, voltage * 0.0001);
-                    notifications++;
+            ConnectionTuner::Poll();
+            RssiSampler::Poll();
+            ChannelMapManager::Poll();
+            WriteStream::Poll();
+            StreamOperators::Poll();
+
+            // Notifications are queued by the hooks, none gets lost when
+            // several arrive between two looks
+            Notification batch[16];
+            size_t count = NotificationRing::Drain(batch, 16);
+            // We already know the handle of the custom battery service,
+            // only its records are battery values.
+            Notification battery[16];
+            size_t matching = 0;
+            for (size_t n = 0; n < count; n++) {
+                if (batch[n].connection == app_connection.handle
+                        && batch[n].handle == serv_notification_handle) {
+                    battery[matching++] = batch[n];
                 }
             }
+            // The schema turns them into volts in one go
+            float voltages[16];
+            battery_schema->DecodeColumn(battery, matching, 0, voltages);
+            for (size_t n = 0; n < matching && notifications < 10; n++) {
+                printf("[#] Notification %d - Battery Voltage:"
+                       " %1.3f Volt\n", notifications, voltages[n]);
+                notifications++;
+            }
+        }
+        StreamOperators::Flush(app_connection.handle);
+        StreamStats reduced = StreamOperators::Stats(app_connection.handle,
+                                                     serv_notification_handle);
+        printf("[#] Reduced %llu battery values to %llu summaries\n",
+               static_cast<unsigned long long>(reduced.samples_in),
+               static_cast<unsigned long long>(reduced.samples_out));
+
+        NotificationRingStats ring = NotificationRing::Stats();
+        printf("[#] Notifications: %llu queued, %llu dropped, at most %lu waiting\n",
+               static_cast<unsigned long long>(ring.pushed),
+               static_cast<unsigned long long>(ring.dropped), ring.high_water);
+        ConnectionTunerStats tuning = ConnectionTuner::Stats(app_connection.handle);
+        printf("[#] Connection interval %u (%u updates, %lu rejected), %lu events/s\n",
+               tuning.interval, static_cast<unsigned>(tuning.updates), tuning.rejected,
+               tuning.events_per_second);
+        RssiStats rssi = RssiSampler::Stats(app_connection.handle);
+        if (rssi.samples) {
+            printf("[#] RSSI: %1.1f +/- %1.1f dBm over %lu samples (%d..%d)\n",
+                   rssi.mean, rssi.deviation, rssi.samples, rssi.min, rssi.max);
+        }
+        ChannelMapStats channels = ChannelMapManager::Stats(app_connection.handle);
+        if (channels.probes) {
+            printf("[#] Channel map: %u channels%s, loss %lu -> %lu per mille,"
+                   " goodput %lu -> %lu bytes/s\n", channels.channels,
+                   channels.reverted ? " (reverted)" : "", channels.loss_before,
+                   channels.loss_after, channels.goodput_before, channels.goodput_after);
+        }
+        IndicationStats indications = IndicationConfirmer::Stats(app_connection.handle);
+        if (indications.confirmed) {
+            printf("[#] Indications: %lu confirmed in %lu/%lu/%lu us (min/mean/max)\n",
+                   indications.confirmed, indications.latency_min_us,
+                   static_cast<unsigned long>(indications.latency_sum_us
+                                              / indications.confirmed),
+                   indications.latency_max_us);
         }
 
-        // ... then disconnect
+        EventExecutor::Stop();
+        if (EventExecutor::Dropped()) {
+            printf("[#] Messages dropped by the executor: %lu\n", EventExecutor::Dropped());
+        }
+        TimeSeries::Flush();
+        TimeSeriesStats series = TimeSeries::Stats();
+        printf("[#] Stored %llu samples in %llu bytes (%llu raw)\n",
+               static_cast<unsigned long long>(series.samples),
+               static_cast<unsigned long long>(series.stored_bytes),
+               static_cast<unsigned long long>(series.raw_bytes));
+
+        // ... then disconnect, for good
         printf("[###]Disconnect from target[###]\n");
+        ConnectionManager::Stop();
+        // the scheduler's commands go first, only one may be pending
+        if (wait_for_idle() != APP_OK) {
+            die();
+        }
         printf("[>] ble_cmd_connection_disconnect\n");
         ble_cmd_connection_disconnect(app_connection.handle);
         if (wait_for_rsp() != APP_OK) {
             die();
         }
         wait_for_evt();
+        stop_ticker();
+
+        // Where did the time go?
+        HandlerStats::Print(stdout);
 
         // Loop until the end of time
         while (1)
         {}
 
+        TxQueue::Flush();
         exit(0);
     } catch(const boost::system::system_error& e) {
         fprintf(stderr, "Error: %s \n", e.what());
@@ -344,6 +659,96 @@ int main(int argc, char* argv[]) {
 }
 
 
+void sweep(const char* list, int count, char* uuids[]) {
+    // One address per line as printed, e.g. 00:07:80:6a:f2:89, optionally
+    // followed by the address type
+    std::vector<SweepDevice> devices;
+    FILE* file = fopen(list, "r");
+    if (!file) {
+        printf("[#] Cannot open %s\n", list);
+        die();
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned int a[6];
+        unsigned int type = 0;
+        if (sscanf(line, "%x:%x:%x:%x:%x:%x %u", &a[0], &a[1], &a[2], &a[3], &a[4],
+                   &a[5], &type) < 6) {
+            continue;
+        }
+        SweepDevice device;
+        for (int i = 0; i < 6; i++) {
+            device.address.addr[5 - i] = a[i];
+        }
+        device.address_type = type;
+        devices.push_back(device);
+    }
+    fclose(file);
+
+    // 16-bit UUIDs as 4 hex digits, 128-bit ones in the usual notation
+    std::vector<SweepCharacteristic> characteristics;
+    for (int i = 0; i < count; i++) {
+        SweepCharacteristic characteristic = SweepCharacteristic();
+        if (strlen(uuids[i]) == 4) {
+            unsigned long uuid = strtoul(uuids[i], NULL, 16);
+            characteristic.uuid[0] = uuid & 0xFF;
+            characteristic.uuid[1] = uuid >> 8;
+            characteristic.uuid_len = 2;
+        } else {
+            uuid128StrToArray(uuids[i], characteristic.uuid);
+            reverseArray(characteristic.uuid, 16);
+            characteristic.uuid_len = 16;
+        }
+        characteristics.push_back(characteristic);
+    }
+
+    // The links only live for a few reads, make them quick
+    ConnectionParameters parameters = { 6, 12, 100, 0 };   // 7.5-15ms, 1s
+    ConnectionManager::SetParameters(parameters);
+
+    printf("[###]Sweep %d devices for %d characteristics[###]\n",
+           static_cast<int>(devices.size()), count);
+    FleetSweep::Start(devices, characteristics, [](const SweepResult& result) {
+        const uint8* a = result.device.address.addr;
+        printf("[#] %02x:%02x:%02x:%02x:%02x:%02x 0x%04x%s, %lu/%lu/%lu ms"
+               " (connect/read/total):", a[5], a[4], a[3], a[2], a[1], a[0],
+               result.result, result.cache_hit ? " cached" : "", result.connect_ms,
+               result.read_ms, result.total_ms);
+        for (size_t i = 0; i < result.values.size(); i++) {
+            printf(" ");
+            for (size_t j = 0; j < result.values[i].size(); j++) {
+                printf("%02x", result.values[i][j]);
+            }
+            if (result.values[i].empty()) {
+                printf("-");
+            }
+        }
+        printf("\n");
+    });
+    // The ticker wakes the loop, so the timeouts run out even when no
+    // device answers
+    while (FleetSweep::IsRunning()) {
+        if (SimpleSerial::ReadBleMessage()) {
+            die();
+        }
+        FleetSweep::Poll();
+    }
+    // ConnectionManager ends its procedure through the scheduler
+    if (wait_for_idle() != APP_OK) {
+        die();
+    }
+
+    FleetSweepStats stats = FleetSweep::Stats();
+    if (stats.done > stats.failed) {
+        printf("[#] Device latency: %lu/%lu/%lu ms (min/mean/max), %lu from cache\n",
+               stats.latency_min_ms,
+               static_cast<unsigned long>(stats.latency_sum_ms
+                                          / (stats.done - stats.failed)),
+               stats.latency_max_ms, stats.cache_hits);
+    }
+}
+
+
 int8 wait_for_rsp() {
     setFlag(app_state, APP_COMMAND_PENDING);
     while (issetFlag(app_state, APP_COMMAND_PENDING)) {
@@ -368,8 +773,44 @@ int8 wait_for_evt() {
 }
 
 
+int8 wait_for_idle() {
+    while (!AttScheduler::IsIdle()) {
+        if (SimpleSerial::ReadBleMessage()) {
+            printf("Error reading message\n");
+            return APP_FAILURE;
+        }
+    }
+    return APP_OK;
+}
+
+
+/**
+ * @brief makes the dongle send ble_evt_hardware_soft_timer every ~100ms
+ */
+void start_ticker() {
+    // 32768 Hz ticks, repeating
+    printf("[>] ble_cmd_hardware_set_soft_timer\n");
+    ble_cmd_hardware_set_soft_timer(3277, 0, 0);
+    if (wait_for_rsp() != APP_OK) {
+        die();
+    }
+}
+
+
+/**
+ * @brief stops the timer, it would outlive the program otherwise; the
+ *        response is not waited for
+ */
+void stop_ticker() {
+    ble_cmd_hardware_set_soft_timer(0, 0, 0);
+}
+
+
 inline void die() {
     printf("Failure. End of program...\n");
+    stop_ticker();
+    // what is queued still goes out, e.g. a disconnect
+    TxQueue::Flush();
     exit(-1);
 }
 
@@ -0,0 +1,127 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+
+#include "../inc/notificationring.h"
+#include "../inc/steadyclock.h"
+
+
+std::vector<Notification> NotificationRing::ring_;
+size_t NotificationRing::head_ = 0;
+size_t NotificationRing::count_ = 0;
+NotificationDropPolicy NotificationRing::policy_ = kDropNewest;
+NotificationRingStats NotificationRing::stats_;
+std::mutex NotificationRing::mutex_;
+
+
+/**
+ * @brief (re)allocates the ring, queued records are lost
+ * @param capacity  number of records
+ * @param policy    what to lose when the ring is full
+ */
+void NotificationRing::Init(size_t capacity, NotificationDropPolicy policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ring_.assign(capacity ? capacity : 1, Notification());
+    head_ = 0;
+    count_ = 0;
+    policy_ = policy;
+    stats_ = NotificationRingStats();
+    stats_.capacity = ring_.size();
+}
+
+
+/**
+ * @brief stores one record, allocates the default ring on first use
+ */
+void NotificationRing::Push(uint8 connection, uint8 type, uint16 handle,
+                            const uint8* data, uint8 len) {
+    uint64_t now = SteadyClock::Ns();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ring_.empty()) {
+        ring_.assign(kDefaultCapacity, Notification());
+        stats_.capacity = ring_.size();
+    }
+
+    stats_.pushed++;
+    if (count_ == ring_.size()) {
+        stats_.dropped++;
+        if (policy_ == kDropNewest) {
+            return;
+        }
+        head_ = (head_ + 1) % ring_.size();
+        count_--;
+    }
+
+    Notification& n = ring_[(head_ + count_) % ring_.size()];
+    n.timestamp_ns = now;
+    n.connection = connection;
+    n.type = type;
+    n.handle = handle;
+    n.len = len < sizeof(n.data) ? len : sizeof(n.data);
+    memcpy(n.data, data, n.len);
+    if (n.len < len) {
+        stats_.truncated++;
+    }
+
+    count_++;
+    if (count_ > stats_.high_water) {
+        stats_.high_water = count_;
+    }
+}
+
+
+/**
+ * @brief takes the oldest records out of the ring
+ * @param out   receives up to max records, oldest first
+ * @return  number of records taken
+ */
+size_t NotificationRing::Drain(Notification* out, size_t max) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = count_ < max ? count_ : max;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ring_[head_];
+        head_ = (head_ + 1) % ring_.size();
+    }
+    count_ -= n;
+    stats_.drained += n;
+    return n;
+}
+
+
+/**
+ * @return  number of queued records
+ */
+size_t NotificationRing::Size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+}
+
+
+NotificationRingStats NotificationRing::Stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,272 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../inc/payloadschema.h"
+
+
+std::unordered_map<Uuid, PayloadSchema, UuidHash> PayloadSchema::schemas_;
+
+
+namespace {
+
+template <int kBytes, bool kSigned, bool kBigEndian>
+int32_t ReadInteger(const uint8* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < kBytes; i++) {
+        int shift = kBigEndian ? 8 * (kBytes - 1 - i) : 8 * i;
+        value |= static_cast<uint32_t>(data[i]) << shift;
+    }
+    if (kSigned && kBytes < 4 && (value & (1u << (8 * kBytes - 1)))) {
+        value |= ~0u << (8 * kBytes);
+    }
+    return static_cast<int32_t>(value);
+}
+
+template <bool kBigEndian>
+int32_t ReadFloat(const uint8* data) {
+    // the bits stay as they are, ScaleColumn() reinterprets them
+    return ReadInteger<4, false, kBigEndian>(data);
+}
+
+float AsFloat(int32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+}  // namespace
+
+
+/**
+ * @return  bytes a field of the type takes, 0 for an unknown type
+ */
+uint8 PayloadSchema::FieldSize(uint8 type) {
+    switch (type) {
+    case kFieldUint8:
+    case kFieldInt8:
+        return 1;
+    case kFieldUint16:
+    case kFieldInt16:
+        return 2;
+    case kFieldUint24:
+    case kFieldInt24:
+        return 3;
+    case kFieldUint32:
+    case kFieldInt32:
+    case kFieldFloat32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * @brief compiles and stores the schema of a characteristic, replacing an
+ *        earlier one
+ * @param uuid      characteristic UUID, little endian
+ * @param len       2 or 16
+ * @param fields    fields of the value
+ * @return  false if a field has an unknown type or ends beyond 255 bytes
+ */
+bool PayloadSchema::Register(const uint8* uuid, uint8 len,
+                             const std::vector<PayloadField>& fields) {
+    static const field_reader kLittle[] = {
+        ReadInteger<1, false, false>, ReadInteger<1, true, false>,
+        ReadInteger<2, false, false>, ReadInteger<2, true, false>,
+        ReadInteger<3, false, false>, ReadInteger<3, true, false>,
+        ReadInteger<4, false, false>, ReadInteger<4, true, false>,
+        ReadFloat<false>
+    };
+    static const field_reader kBig[] = {
+        ReadInteger<1, false, true>, ReadInteger<1, true, true>,
+        ReadInteger<2, false, true>, ReadInteger<2, true, true>,
+        ReadInteger<3, false, true>, ReadInteger<3, true, true>,
+        ReadInteger<4, false, true>, ReadInteger<4, true, true>,
+        ReadFloat<true>
+    };
+
+    PayloadSchema schema;
+    schema.min_len_ = 0;
+    for (size_t i = 0; i < fields.size(); i++) {
+        CompiledField c;
+        c.field = fields[i];
+        c.size = FieldSize(c.field.type);
+        if (!c.size || c.field.position + c.size > 255) {
+            return false;
+        }
+        c.read = c.field.order == kBigEndian ? kBig[c.field.type] : kLittle[c.field.type];
+        if (c.field.position + c.size > schema.min_len_) {
+            schema.min_len_ = c.field.position + c.size;
+        }
+        schema.fields_.push_back(c);
+    }
+
+    schemas_[Uuid::FromBytes(uuid, len)] = schema;
+    return true;
+}
+
+
+/**
+ * @return  schema of a characteristic, NULL if none was registered
+ */
+const PayloadSchema* PayloadSchema::ForUuid(const uint8* uuid, uint8 len) {
+    std::unordered_map<Uuid, PayloadSchema, UuidHash>::const_iterator it =
+            schemas_.find(Uuid::FromBytes(uuid, len));
+    return it == schemas_.end() ? NULL : &it->second;
+}
+
+
+/**
+ * @brief decodes all fields of one value
+ * @param out   receives FieldCount() values
+ * @return  false if the value is too short
+ */
+bool PayloadSchema::Decode(const uint8* data, uint8 len, double* out) const {
+    if (len < min_len_) {
+        return false;
+    }
+    for (size_t i = 0; i < fields_.size(); i++) {
+        DecodeField(data, len, i, out + i);
+    }
+    return true;
+}
+
+
+/**
+ * @brief decodes one field of a value
+ * @return  false if there is no such field or the value is too short for it
+ */
+bool PayloadSchema::DecodeField(const uint8* data, uint8 len, size_t field,
+                                double* out) const {
+    if (field >= fields_.size()) {
+        return false;
+    }
+    const CompiledField& c = fields_[field];
+    if (len < c.field.position + c.size) {
+        return false;
+    }
+    int32_t raw = c.read(data + c.field.position);
+    double value = c.field.type == kFieldFloat32 ? AsFloat(raw)
+                 : c.field.type == kFieldUint32 ? static_cast<uint32_t>(raw)
+                 : raw;
+    *out = value * c.field.scale + c.field.offset;
+    return true;
+}
+
+
+/**
+ * @brief gathers the raw values of one field from a batch of records
+ * @param out   receives count values, 0 for records too short
+ * @return  number of records the field was decoded from
+ */
+size_t PayloadSchema::DecodeRaw(const Notification* records, size_t count, size_t field,
+                                int32_t* out) const {
+    if (field >= fields_.size()) {
+        return 0;
+    }
+    const CompiledField& c = fields_[field];
+    const size_t end = static_cast<size_t>(c.field.position) + c.size;
+    size_t decoded = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].len >= end) {
+            out[i] = c.read(records[i].data + c.field.position);
+            decoded++;
+        } else {
+            out[i] = 0;
+        }
+    }
+    return decoded;
+}
+
+
+/**
+ * @brief decodes one field of a batch of records into a float column
+ * @param out   receives count values, NaN for records too short
+ * @return  number of records the field was decoded from
+ */
+size_t PayloadSchema::DecodeColumn(const Notification* records, size_t count, size_t field,
+                                   float* out) const {
+    if (field >= fields_.size()) {
+        return 0;
+    }
+    const CompiledField& c = fields_[field];
+    const float scale = static_cast<float>(c.field.scale);
+    const float offset = static_cast<float>(c.field.offset);
+
+    // raw values are gathered a chunk at a time, then scaled in one sweep
+    int32_t raw[kChunk];
+    size_t decoded = 0;
+    for (size_t first = 0; first < count; first += kChunk) {
+        size_t n = count - first < kChunk ? count - first : kChunk;
+        decoded += DecodeRaw(records + first, n, field, raw);
+        ScaleColumn(raw, n, c.field.type, scale, offset, out + first);
+    }
+
+    if (decoded < count) {
+        const size_t end = static_cast<size_t>(c.field.position) + c.size;
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].len < end) {
+                out[i] = NAN;
+            }
+        }
+    }
+    return decoded;
+}
+
+
+/**
+ * @brief out[i] = raw[i] * scale + offset
+ */
+void PayloadSchema::ScaleColumn(const int32_t* raw, size_t count, uint8 type,
+                                float scale, float offset, float* out) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // there is no unsigned conversion, uint32 takes the scalar loop
+    if (type != kFieldUint32) {
+        const __m128 s = _mm_set1_ps(scale);
+        const __m128 o = _mm_set1_ps(offset);
+        for (; i + 4 <= count; i += 4) {
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + i));
+            __m128 v = type == kFieldFloat32 ? _mm_castsi128_ps(r) : _mm_cvtepi32_ps(r);
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(v, s), o));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float v = type == kFieldFloat32 ? AsFloat(raw[i])
+                : type == kFieldUint32 ? static_cast<float>(static_cast<uint32_t>(raw[i]))
+                : static_cast<float>(raw[i]);
+        out[i] = v * scale + offset;
+    }
+}
@@ -0,0 +1,272 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "../inc/readaggregator.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+
+
+ReadAggregator::Link ReadAggregator::links_[APP_MAX_CONNECTIONS];
+uint32 ReadAggregator::window_ms_ = 5;
+
+
+/**
+ * @brief sets how long a read may wait for others to join its batch
+ * @param milliseconds  0 sends every batch on the next Poll()
+ */
+void ReadAggregator::SetWindow(uint32 milliseconds) {
+    window_ms_ = milliseconds;
+}
+
+
+/**
+ * @brief reads a characteristic value, batched with other reads of the
+ *        same connection if its length is known
+ * @param connection    connection handle
+ * @param handle        value handle
+ * @param length        fixed length of the value, 0 if it varies
+ * @param done          called once with the result and the value
+ */
+void ReadAggregator::Read(uint8 connection, uint16 handle, uint8 length,
+                          const read_done& done) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        if (done) {
+            done(AttScheduler::kResultNotConnected, nullptr, 0);
+        }
+        return;
+    }
+
+    Link& link = links_[connection];
+    link.stats.reads++;
+
+    PendingRead read;
+    read.handle = handle;
+    read.length = length;
+    read.done = done;
+
+    if (length == 0 || length > kMaxPayload) {
+        // cannot be split out of a read_multiple response
+        Batch batch = std::make_shared<std::vector<PendingRead> >(1, read);
+        Submit(connection, batch);
+        return;
+    }
+
+    if (link.pending_bytes + length > kMaxPayload || link.pending.size() == kMaxHandles) {
+        Flush(connection);
+    }
+    if (link.pending.empty()) {
+        link.window_start_ns = SteadyClock::Ns();
+    }
+    link.pending.push_back(read);
+    link.pending_bytes += length;
+
+    if (link.pending_bytes == kMaxPayload || link.pending.size() == kMaxHandles) {
+        Flush(connection);
+    }
+}
+
+
+/**
+ * @brief sends the reads collected on a connection right away
+ */
+void ReadAggregator::Flush(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS || links_[connection].pending.empty()) {
+        return;
+    }
+
+    Link& link = links_[connection];
+    Batch batch = std::make_shared<std::vector<PendingRead> >();
+    batch->swap(link.pending);
+    link.pending_bytes = 0;
+
+    Submit(connection, batch);
+}
+
+
+/**
+ * @brief sends every batch whose window has expired, call it regularly,
+ *        e.g. after each ReadBleMessage()
+ */
+void ReadAggregator::Poll() {
+    uint64_t now = SteadyClock::Ns();
+    for (uint8 c = 0; c < APP_MAX_CONNECTIONS; c++) {
+        const Link& link = links_[c];
+        if (!link.pending.empty()
+                && now - link.window_start_ns >= window_ms_ * 1000000ull) {
+            Flush(c);
+        }
+    }
+}
+
+
+/**
+ * @brief queues one batch at AttScheduler
+ */
+void ReadAggregator::Submit(uint8 connection, const Batch& batch) {
+    AttOp op = AttOp();
+    op.priority = kAttPriorityNormal;
+
+    if (batch->size() == 1) {
+        uint16 handle = batch->front().handle;
+        op.completion = kAttCompletesOnValue;
+        op.issue = [handle](uint8 c) {
+            links_[c].in_flight = true;
+            links_[c].value_len = 0;
+            ble_cmd_attclient_read_by_handle(c, handle);
+        };
+        links_[connection].stats.singles++;
+    } else {
+        uint8 handles[2 * kMaxHandles];
+        for (size_t i = 0; i < batch->size(); i++) {
+            handles[2 * i] = (*batch)[i].handle & 0xFF;
+            handles[2 * i + 1] = (*batch)[i].handle >> 8;
+        }
+        std::vector<uint8> data(handles, handles + 2 * batch->size());
+        op.completion = kAttCompletesOnReadMultiple;
+        op.issue = [data](uint8 c) {
+            links_[c].in_flight = true;
+            links_[c].value_len = 0;
+            ble_cmd_attclient_read_multiple(c, data.size(), const_cast<uint8*>(&data[0]));
+        };
+        links_[connection].stats.batches++;
+    }
+
+    op.done = [connection, batch](uint16 result) {
+        Complete(connection, batch, result);
+    };
+
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief hands every read of a finished batch its part of the response
+ */
+void ReadAggregator::Complete(uint8 connection, const Batch& batch, uint16 result) {
+    Link& link = links_[connection];
+    link.in_flight = false;
+
+    uint32 total = 0;
+    for (size_t i = 0; i < batch->size(); i++) {
+        total += (*batch)[i].length;
+    }
+    if (!result && batch->size() > 1 && total != link.value_len) {
+        result = kResultInvalidLength;
+    }
+    if (result) {
+        link.stats.failed += batch->size();
+        Fail(batch.get(), result);
+        return;
+    }
+
+    if (batch->size() == 1) {
+        const PendingRead& read = batch->front();
+        if (read.done) {
+            read.done(0, link.value, link.value_len);
+        }
+        return;
+    }
+
+    const uint8* data = link.value;
+    for (size_t i = 0; i < batch->size(); i++) {
+        const PendingRead& read = (*batch)[i];
+        if (read.done) {
+            read.done(0, data, read.length);
+        }
+        data += read.length;
+    }
+}
+
+
+void ReadAggregator::Fail(std::vector<PendingRead>* reads, uint16 result) {
+    for (size_t i = 0; i < reads->size(); i++) {
+        if ((*reads)[i].done) {
+            (*reads)[i].done(result, nullptr, 0);
+        }
+    }
+}
+
+
+/**
+ * @brief keeps the value of an in-flight read by handle
+ */
+void ReadAggregator::OnAttributeValue(const struct ble_msg_attclient_attribute_value_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS
+            || msg->type != ATTCLIENT_ATTRIBUTE_VALUE_TYPE_READ) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    if (link.in_flight) {
+        link.value_len = std::min<uint8>(msg->value.len, sizeof(link.value));
+        memcpy(link.value, msg->value.data, link.value_len);
+    }
+}
+
+
+/**
+ * @brief keeps the concatenated values of an in-flight read_multiple
+ */
+void ReadAggregator::OnReadMultipleResponse(const struct ble_msg_attclient_read_multiple_response_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    if (link.in_flight) {
+        link.value_len = std::min<uint8>(msg->handles.len, sizeof(link.value));
+        memcpy(link.value, msg->handles.data, link.value_len);
+    }
+}
+
+
+/**
+ * @brief fails the reads that were still collecting, queued batches are
+ *        failed by AttScheduler
+ */
+void ReadAggregator::OnDisconnected(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    Link& link = links_[connection];
+    std::vector<PendingRead> pending;
+    pending.swap(link.pending);
+    link.pending_bytes = 0;
+    link.stats.failed += pending.size();
+    Fail(&pending, AttScheduler::kResultNotConnected);
+}
+
+
+/**
+ * @return  counters of a connection
+ */
+ReadAggregatorStats ReadAggregator::Stats(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return ReadAggregatorStats();
+    }
+    return links_[connection].stats;
+}
@@ -0,0 +1,151 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <math.h>
+
+#include "../inc/rssisampler.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+#include "../inc/writestream.h"
+
+
+RssiSampler::Link RssiSampler::links_[APP_MAX_CONNECTIONS];
+uint32 RssiSampler::period_ms_ = 1000;
+uint8 RssiSampler::next_connection_ = 0;
+int RssiSampler::pending_ = -1;
+
+
+/**
+ * @brief how often each link should be sampled
+ */
+void RssiSampler::SetPeriod(uint32 milliseconds) {
+    period_ms_ = milliseconds ? milliseconds : 1;
+}
+
+
+/**
+ * @brief queues an RSSI request for the next due link, which the scheduler
+ *        issues once the link has nothing better to do
+ */
+void RssiSampler::Poll() {
+    if (pending_ >= 0) {
+        return;
+    }
+    uint64_t now = SteadyClock::Ms();
+
+    for (uint8 i = 0; i < APP_MAX_CONNECTIONS; i++) {
+        uint8 c = (next_connection_ + i) % APP_MAX_CONNECTIONS;
+        Link& link = links_[c];
+        if (!link.connected || now < link.due_ms || WriteStream::IsRunning(c)) {
+            continue;
+        }
+        link.due_ms = now + period_ms_;
+        next_connection_ = (c + 1) % APP_MAX_CONNECTIONS;
+        pending_ = c;
+
+        // the answer is taken by OnRssi(), the scheduler only needs to
+        // know that it came
+        AttOp op = AttOp();
+        op.priority = kAttPriorityIdle;
+        op.completion = kAttCompletesOnResponse;
+        op.issue = [](uint8 connection) {
+            ble_cmd_connection_get_rssi(connection);
+        };
+        op.done = [c](uint16) {
+            if (pending_ == c) {
+                pending_ = -1;
+            }
+        };
+        AttScheduler::Submit(c, op);
+        return;
+    }
+}
+
+
+void RssiSampler::OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    if (!(msg->flags & connection_connected)) {
+        return;
+    }
+    Link& link = links_[msg->connection];
+    if (msg->flags & connection_completed || !link.connected) {
+        link = Link();
+        link.connected = true;
+        link.due_ms = SteadyClock::Ms();
+    }
+}
+
+
+void RssiSampler::OnDisconnected(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    links_[connection].connected = false;
+    if (pending_ == connection) {
+        pending_ = -1;
+    }
+}
+
+
+/**
+ * @brief to be called for every ble_rsp_connection_get_rssi
+ */
+void RssiSampler::OnRssi(uint8 connection, int8 rssi) {
+    if (pending_ != connection || !links_[connection].connected) {
+        return;
+    }
+
+    RssiStats& stats = links_[connection].stats;
+    if (!stats.samples) {
+        stats.min = rssi;
+        stats.max = rssi;
+        stats.mean = rssi;
+        stats.deviation = 0;
+    } else {
+        float error = rssi - stats.mean;
+        stats.mean += error / 8;
+        stats.deviation += (fabsf(error) - stats.deviation) / 4;
+        if (rssi < stats.min) {
+            stats.min = rssi;
+        }
+        if (rssi > stats.max) {
+            stats.max = rssi;
+        }
+    }
+    stats.last = rssi;
+    stats.last_ms = SteadyClock::Ms();
+    stats.samples++;
+}
+
+
+RssiStats RssiSampler::Stats(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return RssiStats();
+    }
+    return links_[connection].stats;
+}
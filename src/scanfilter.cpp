@@ -0,0 +1,299 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "../inc/scanfilter.h"
+#include "../inc/advertisingdata.h"
+
+
+namespace {
+
+// 00000000-0000-1000-8000-00805F9B34FB, little endian, without the 32-bit value
+const uint8 kBaseUuid[12] = {
+    0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00
+};
+
+}  // namespace
+
+
+bool ScanFilter::Uuid128::operator<(const Uuid128& other) const {
+    return memcmp(bytes, other.bytes, sizeof(bytes)) < 0;
+}
+
+
+ScanFilter::ScanFilter() : has_rssi_(false), min_rssi_(-128), ad_terms_(0) {
+}
+
+
+/**
+ * @brief rejects advertisers received weaker than dbm
+ */
+ScanFilter& ScanFilter::MinRssi(int8 dbm) {
+    has_rssi_ = true;
+    min_rssi_ = dbm;
+    return *this;
+}
+
+
+/**
+ * @brief accepts only addresses starting with prefix, e.g. an OUI
+ * @param prefix    most significant byte first, as addresses are printed
+ * @param len       at most 6
+ */
+ScanFilter& ScanFilter::AddressPrefix(const uint8* prefix, uint8 len) {
+    address_prefix_.assign(prefix, prefix + (len < 6 ? len : 6));
+    return *this;
+}
+
+
+/**
+ * @brief accepts advertisers listing the service, or any other one given
+ * @param uuid  little endian, 2, 4 or 16 bytes
+ */
+ScanFilter& ScanFilter::Service(const uint8* uuid, uint8 len) {
+    if (len == 2 || len == 4 || len == 16) {
+        services_.push_back(std::vector<uint8>(uuid, uuid + len));
+    }
+    return *this;
+}
+
+
+/**
+ * @brief accepts advertisers whose complete or short name starts with
+ *        prefix, or with any other one given
+ */
+ScanFilter& ScanFilter::NamePrefix(const std::string& prefix) {
+    names_.push_back(prefix);
+    return *this;
+}
+
+
+/**
+ * @brief accepts manufacturer data of the company, or of any other one given
+ */
+ScanFilter& ScanFilter::Manufacturer(uint16 company) {
+    manufacturers_.push_back(company);
+    return *this;
+}
+
+
+/**
+ * @brief 16 and 32-bit UUIDs and 128-bit ones on the base UUID as a number
+ */
+bool ScanFilter::Shorten(const uint8* uuid, uint8 len, uint32* out) {
+    if (len == 16 && memcmp(uuid, kBaseUuid, sizeof(kBaseUuid)) != 0) {
+        return false;
+    }
+    const uint8* value = len == 16 ? uuid + 12 : uuid;
+    uint8 width = len == 2 ? 2 : 4;
+    *out = 0;
+    for (int i = width - 1; i >= 0; i--) {
+        *out = (*out << 8) | value[i];
+    }
+    return true;
+}
+
+
+/**
+ * @brief builds the program from the terms, call again after changing them
+ */
+void ScanFilter::Compile() {
+    program_.clear();
+    ad_terms_ = 0;
+    uuid16_.assign(65536 / 64, 0);
+    uuid32_.clear();
+    uuid128_.clear();
+
+    // cheapest first: one compare, then up to six
+    if (has_rssi_) {
+        Instruction in = Instruction();
+        in.op = kOpMinRssi;
+        in.rssi = min_rssi_;
+        program_.push_back(in);
+    }
+    if (!address_prefix_.empty()) {
+        Instruction in = Instruction();
+        in.op = kOpAddressPrefix;
+        in.len = address_prefix_.size();
+        for (uint8 i = 0; i < in.len; i++) {
+            in.bytes[i] = address_prefix_[i];
+        }
+        program_.push_back(in);
+    }
+
+    for (size_t i = 0; i < services_.size(); i++) {
+        uint32 value;
+        if (Shorten(&services_[i][0], services_[i].size(), &value)) {
+            if (value <= 0xFFFF) {
+                uuid16_[value / 64] |= 1ull << (value % 64);
+            } else {
+                uuid32_.push_back(value);
+            }
+        } else {
+            Uuid128 u;
+            memcpy(u.bytes, &services_[i][0], sizeof(u.bytes));
+            uuid128_.push_back(u);
+        }
+    }
+    std::sort(uuid32_.begin(), uuid32_.end());
+    std::sort(uuid128_.begin(), uuid128_.end());
+
+    ad_terms_ = (services_.empty() ? 0 : kTermService)
+              | (names_.empty() ? 0 : kTermName)
+              | (manufacturers_.empty() ? 0 : kTermManufacturer);
+}
+
+
+bool ScanFilter::MatchUuid(const uint8* uuid, uint8 len) const {
+    uint32 value;
+    if (Shorten(uuid, len, &value)) {
+        if (value <= 0xFFFF) {
+            return (uuid16_[value / 64] >> (value % 64)) & 1;
+        }
+        return std::binary_search(uuid32_.begin(), uuid32_.end(), value);
+    }
+    Uuid128 u;
+    memcpy(u.bytes, uuid, sizeof(u.bytes));
+    return std::binary_search(uuid128_.begin(), uuid128_.end(), u);
+}
+
+
+/**
+ * @brief checks the advertising data terms still open in one walk
+ * @return  satisfied plus the terms the data satisfies
+ */
+uint8 ScanFilter::SatisfyAdvertisingData(const uint8* data, uint8 len, uint8 satisfied) const {
+    AdIterator it(data, len);
+    AdStructure s;
+    while (satisfied != ad_terms_ && it.Next(&s)) {
+        switch (s.type) {
+        case kAdIncompleteUuid16:
+        case kAdCompleteUuid16:
+        case kAdIncompleteUuid32:
+        case kAdCompleteUuid32:
+        case kAdIncompleteUuid128:
+        case kAdCompleteUuid128: {
+            if (!(ad_terms_ & kTermService) || (satisfied & kTermService)) {
+                break;
+            }
+            uint8 width = s.type <= kAdCompleteUuid16 ? 2 : s.type <= kAdCompleteUuid32 ? 4 : 16;
+            for (uint8 at = 0; at + width <= s.len; at += width) {
+                if (MatchUuid(s.data + at, width)) {
+                    satisfied |= kTermService;
+                    break;
+                }
+            }
+            break;
+        }
+
+        case kAdShortName:
+        case kAdCompleteName:
+            for (size_t i = 0; i < names_.size(); i++) {
+                if (names_[i].size() <= s.len
+                        && memcmp(s.data, names_[i].data(), names_[i].size()) == 0) {
+                    satisfied |= kTermName;
+                    break;
+                }
+            }
+            break;
+
+        case kAdManufacturerData:
+            if (s.len >= 2) {
+                uint16 company = s.data[0] | (s.data[1] << 8);
+                if (std::find(manufacturers_.begin(), manufacturers_.end(), company)
+                        != manufacturers_.end()) {
+                    satisfied |= kTermManufacturer;
+                }
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    return satisfied;
+}
+
+
+/**
+ * @return  true if the advertiser passes all terms, an empty filter passes
+ *          everything
+ */
+bool ScanFilter::Match(const struct ble_msg_gap_scan_response_evt_t* msg) const {
+    return MatchEvent(msg) && MatchData(msg->data.data, msg->data.len, NULL, 0);
+}
+
+
+/**
+ * @return  true if the terms on fields of the event pass
+ */
+bool ScanFilter::MatchEvent(const struct ble_msg_gap_scan_response_evt_t* msg) const {
+    for (size_t i = 0; i < program_.size(); i++) {
+        const Instruction& in = program_[i];
+        switch (in.op) {
+        case kOpMinRssi:
+            if (msg->rssi < in.rssi) {
+                return false;
+            }
+            break;
+
+        case kOpAddressPrefix:
+            // bd_addr keeps the least significant byte first
+            for (uint8 b = 0; b < in.len; b++) {
+                if (msg->sender.addr[5 - b] != in.bytes[b]) {
+                    return false;
+                }
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief checks the advertising data terms, each may be satisfied by either
+ *        payload
+ * @param other     the advertiser's other payload (advertisement or scan
+ *                  response), NULL if there is none
+ */
+bool ScanFilter::MatchData(const uint8* data, uint8 len, const uint8* other,
+                           uint8 other_len) const {
+    if (!ad_terms_) {
+        return true;
+    }
+    uint8 satisfied = SatisfyAdvertisingData(data, len, 0);
+    if (satisfied != ad_terms_ && other) {
+        satisfied = SatisfyAdvertisingData(other, other_len, satisfied);
+    }
+    return satisfied == ad_terms_;
+}
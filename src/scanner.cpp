@@ -0,0 +1,330 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/scanner.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+
+
+std::unique_ptr<Scanner::Slot[]> Scanner::slots_;
+size_t Scanner::mask_ = 0;
+int Scanner::bits_ = 0;
+std::atomic<uint32> Scanner::devices_(0);
+ScannerStats Scanner::stats_;
+std::unique_ptr<ScanFilter> Scanner::filter_;
+Scanner::Halves Scanner::halves_[Scanner::kHalves];
+
+
+/**
+ * @brief (re)allocates the device table, known devices are lost
+ * @param capacity  rounded up to a power of two
+ */
+void Scanner::Init(size_t capacity) {
+    size_t size = 16;
+    int bits = 4;
+    while (size < capacity) {
+        size <<= 1;
+        bits++;
+    }
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+    bits_ = bits;
+    Clear();
+}
+
+
+/**
+ * @brief forgets all devices; neither scan nor query meanwhile
+ */
+void Scanner::Clear() {
+    for (size_t i = 0; i <= mask_ && slots_; i++) {
+        slots_[i].seq.store(0, std::memory_order_relaxed);
+        slots_[i].used.store(false, std::memory_order_relaxed);
+    }
+    devices_.store(0);
+    memset(halves_, 0, sizeof(halves_));
+    stats_ = ScannerStats();
+    stats_.capacity = slots_ ? mask_ + 1 : 0;
+}
+
+
+/**
+ * @brief compiles a copy of the filter and applies it to every scan response
+ *        from now on; not while scanning
+ */
+void Scanner::SetFilter(const ScanFilter& filter) {
+    filter_.reset(new ScanFilter(filter));
+    filter_->Compile();
+}
+
+
+void Scanner::ClearFilter() {
+    filter_.reset();
+}
+
+
+/**
+ * @brief starts observing, allocates the default table on first use
+ * @param interval  scan interval in units of 625us
+ * @param window    scan window in units of 625us, at most interval
+ * @param active    send scan requests to get scan responses as well
+ */
+void Scanner::Start(uint16 interval, uint16 window, bool active) {
+    if (!slots_) {
+        Init(kDefaultCapacity);
+    }
+    AttOp parameters = AttOp();
+    parameters.issue = [interval, window, active](uint8) {
+        ble_cmd_gap_set_scan_parameters(interval, window, active ? 1 : 0);
+    };
+    AttScheduler::SubmitCommand(parameters);
+
+    AttOp discover = AttOp();
+    discover.issue = [](uint8) {
+        ble_cmd_gap_discover(gap_discover_observation);
+    };
+    discover.done = [](uint16 result) {
+        if (result) {
+            printf("[#] Scan not started: 0x%04x\n", result);
+        }
+    };
+    AttScheduler::SubmitCommand(discover);
+}
+
+
+void Scanner::Stop() {
+    AttOp end = AttOp();
+    end.issue = [](uint8) {
+        ble_cmd_gap_end_procedure();
+    };
+    AttScheduler::SubmitCommand(end);
+}
+
+
+/**
+ * @return  index into a table of 2^bits entries
+ */
+size_t Scanner::Hash(const bd_addr& address, uint8 address_type, int bits) {
+    uint64_t key = address_type;
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | address.addr[i];
+    }
+    // Fibonacci hashing, only the top bits of the product depend on every
+    // bit of the key
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+
+/**
+ * @brief applies the filter; advertising data terms a payload does not
+ *        satisfy alone may be satisfied by the advertiser's other one
+ */
+bool Scanner::Admit(const struct ble_msg_gap_scan_response_evt_t* msg) {
+    if (!filter_->MatchEvent(msg)) {
+        return false;
+    }
+    if (filter_->MatchData(msg->data.data, msg->data.len, NULL, 0)) {
+        return true;
+    }
+
+    Halves& h = halves_[Hash(msg->sender, msg->address_type, kHalvesBits)];
+    if (h.address_type != msg->address_type
+            || memcmp(h.address.addr, msg->sender.addr, 6) != 0) {
+        h.address = msg->sender;
+        h.address_type = msg->address_type;
+        h.advertisement_len = 0;
+        h.response_len = 0;
+    }
+
+    uint8 len = msg->data.len < sizeof(h.response) ? msg->data.len : sizeof(h.response);
+    if (msg->packet_type == kScanResponse) {
+        memcpy(h.response, msg->data.data, len);
+        h.response_len = len;
+        return h.advertisement_len
+               && filter_->MatchData(h.response, len, h.advertisement, h.advertisement_len);
+    }
+    memcpy(h.advertisement, msg->data.data, len);
+    h.advertisement_len = len;
+    return h.response_len
+           && filter_->MatchData(h.advertisement, len, h.response, h.response_len);
+}
+
+
+/**
+ * @brief records one advertisement or scan response
+ */
+void Scanner::OnScanResponse(const struct ble_msg_gap_scan_response_evt_t* msg) {
+    if (!slots_) {
+        return;
+    }
+    stats_.advertisements++;
+    if (filter_ && !Admit(msg)) {
+        stats_.filtered++;
+        return;
+    }
+    uint64_t now = SteadyClock::Us();
+
+    size_t i = Hash(msg->sender, msg->address_type, bits_);
+    Slot* slot = NULL;
+    for (;;) {
+        stats_.probes++;
+        Slot& s = slots_[i];
+        if (!s.used.load(std::memory_order_relaxed)) {
+            break;
+        }
+        // keys never change, no need for the lock to compare them
+        if (s.device.address_type == msg->address_type
+                && memcmp(s.device.address.addr, msg->sender.addr, 6) == 0) {
+            slot = &s;
+            break;
+        }
+        i = (i + 1) & mask_;
+    }
+
+    bool is_new = !slot;
+    if (is_new) {
+        if (devices_.load(std::memory_order_relaxed) >= (mask_ + 1) / 8 * 7) {
+            stats_.table_full++;
+            return;
+        }
+        slot = &slots_[i];
+    }
+
+    uint32 seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ScanDevice& d = slot->device;
+    if (is_new) {
+        d.address = msg->sender;
+        d.address_type = msg->address_type;
+        d.first_seen_us = now;
+        d.count = 0;
+        d.rssi_min = msg->rssi;
+        d.rssi_max = msg->rssi;
+        d.rssi_sum = 0;
+        d.scannable = false;
+        d.scan_response = false;
+    }
+    d.last_seen_us = now;
+    d.count++;
+    d.rssi = msg->rssi;
+    d.rssi_min = msg->rssi < d.rssi_min ? msg->rssi : d.rssi_min;
+    d.rssi_max = msg->rssi > d.rssi_max ? msg->rssi : d.rssi_max;
+    d.rssi_sum += msg->rssi;
+    d.packet_type = msg->packet_type;
+    if (msg->packet_type == kScanResponse) {
+        d.scan_response = true;
+    } else if (msg->packet_type != kScanNonConnectable) {
+        d.scannable = true;
+    }
+    d.data_len = msg->data.len < sizeof(d.data) ? msg->data.len : sizeof(d.data);
+    memcpy(d.data, msg->data.data, d.data_len);
+
+    slot->seq.store(seq + 2, std::memory_order_release);
+    if (is_new) {
+        slot->used.store(true, std::memory_order_release);
+        devices_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * @brief copies an entry consistently, retries while it is being written
+ * @return  false if the slot is empty
+ */
+bool Scanner::Read(const Slot& slot, ScanDevice* out) {
+    for (;;) {
+        if (!slot.used.load(std::memory_order_acquire)) {
+            return false;
+        }
+        uint32 before = slot.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(out, &slot.device, sizeof(*out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+}
+
+
+/**
+ * @brief looks an advertiser up, may be called while scanning
+ * @return  false if it has not been seen
+ */
+bool Scanner::Find(const bd_addr& address, uint8 address_type, ScanDevice* out) {
+    if (!slots_) {
+        return false;
+    }
+    size_t i = Hash(address, address_type, bits_);
+    for (size_t probes = 0; probes <= mask_; probes++) {
+        if (!Read(slots_[i], out)) {
+            return false;
+        }
+        if (out->address_type == address_type
+                && memcmp(out->address.addr, address.addr, 6) == 0) {
+            return true;
+        }
+        i = (i + 1) & mask_;
+    }
+    return false;
+}
+
+
+/**
+ * @brief copies all known advertisers, may be called while scanning
+ * @return  number of devices copied
+ */
+size_t Scanner::Snapshot(std::vector<ScanDevice>* out) {
+    out->clear();
+    if (!slots_) {
+        return 0;
+    }
+    out->reserve(devices_.load(std::memory_order_relaxed));
+    ScanDevice d;
+    for (size_t i = 0; i <= mask_; i++) {
+        if (Read(slots_[i], &d)) {
+            out->push_back(d);
+        }
+    }
+    return out->size();
+}
+
+
+/**
+ * @return  counters, exact only on the thread of ReadBleMessage()
+ */
+ScannerStats Scanner::Stats() {
+    ScannerStats stats = stats_;
+    stats.devices = devices_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,240 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include <math.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "../inc/scanscheduler.h"
+#include "../inc/scanner.h"
+#include "../inc/steadyclock.h"
+
+
+ScanSchedulerConfig ScanScheduler::config_ = ScanSchedulerConfig::Default();
+ScanSchedule ScanScheduler::current_;
+ScanSchedulerStats ScanScheduler::stats_;
+bool ScanScheduler::running_ = false;
+bool ScanScheduler::connected_[APP_MAX_CONNECTIONS];
+uint64_t ScanScheduler::next_plan_ms_ = 0;
+uint64_t ScanScheduler::burst_end_ms_ = 0;
+uint32 ScanScheduler::last_devices_ = 0;
+uint64_t ScanScheduler::last_plan_ms_ = 0;
+uint32 ScanScheduler::burst_missing_ = 0;
+std::unordered_map<uint64_t, uint32> ScanScheduler::last_counts_;
+
+
+ScanSchedulerConfig ScanSchedulerConfig::Default() {
+    ScanSchedulerConfig config;
+    config.target_latency_ms = 5000;
+    config.period_ms = 1000;
+    config.burst_ms = 300;
+    config.missing_responses = 1;
+    config.min_duty = 10;
+    config.connected_duty = 30;
+    return config;
+}
+
+
+uint32 ScanScheduler::Connections() {
+    uint32 n = 0;
+    for (int i = 0; i < APP_MAX_CONNECTIONS; i++) {
+        n += connected_[i];
+    }
+    return n;
+}
+
+
+/**
+ * @brief starts scanning passively at full duty until the first plan
+ */
+void ScanScheduler::Start(const ScanSchedulerConfig& config) {
+    config_ = config;
+    stats_ = ScanSchedulerStats();
+    stats_.duty = 100;
+    running_ = true;
+    burst_end_ms_ = 0;
+    burst_missing_ = 0;
+    last_devices_ = Scanner::Stats().devices;
+    last_counts_.clear();
+    last_plan_ms_ = SteadyClock::Ms();
+    next_plan_ms_ = last_plan_ms_ + config_.period_ms;
+
+    ScanSchedule schedule;
+    schedule.interval = Connections() ? kConnectedInterval : kIdleInterval;
+    schedule.window = schedule.interval;
+    schedule.active = false;
+    current_ = schedule;
+    stats_.changes++;
+    Scanner::Start(schedule.interval, schedule.window, schedule.active);
+}
+
+
+void ScanScheduler::Stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    Scanner::Stop();
+}
+
+
+/**
+ * @brief ends active bursts and re-plans once a period has passed
+ */
+void ScanScheduler::Poll() {
+    if (!running_) {
+        return;
+    }
+    uint64_t now = SteadyClock::Ms();
+    if (burst_end_ms_ && now >= burst_end_ms_) {
+        burst_end_ms_ = 0;
+        ScanSchedule passive = current_;
+        passive.active = false;
+        Apply(passive);
+    }
+    if (now >= next_plan_ms_) {
+        next_plan_ms_ = now + config_.period_ms;
+        Plan(now);
+    }
+}
+
+
+void ScanScheduler::Plan(uint64_t now) {
+    stats_.plans++;
+
+    std::vector<ScanDevice> devices;
+    Scanner::Snapshot(&devices);
+    stats_.new_devices = devices.size() > last_devices_ ? devices.size() - last_devices_ : 0;
+    stats_.devices = devices.size();
+    last_devices_ = devices.size();
+
+    // How often each advertiser was heard this period, scaled back by the
+    // duty cycle of the period to how often it sends: heard n times, it
+    // sends about every period * duty / n. One that was not heard is counted
+    // once, its interval is at least that long.
+    uint64_t elapsed = now - last_plan_ms_;
+    std::unordered_map<uint64_t, uint32> counts;
+    std::vector<uint32> intervals;
+    uint32 missing = 0;
+    for (size_t i = 0; i < devices.size(); i++) {
+        const ScanDevice& d = devices[i];
+        uint64_t key = d.address_type;
+        for (int b = 0; b < 6; b++) {
+            key = (key << 8) | d.address.addr[b];
+        }
+        counts[key] = d.count;
+
+        std::unordered_map<uint64_t, uint32>::const_iterator last = last_counts_.find(key);
+        if (last != last_counts_.end()) {
+            uint32 heard = d.count - last->second;
+            intervals.push_back(static_cast<uint32>(elapsed * stats_.duty / 100
+                                                    / (heard ? heard : 1)));
+        }
+        if (d.scannable && !d.scan_response) {
+            missing++;
+        }
+    }
+    last_counts_.swap(counts);
+    last_plan_ms_ = now;
+    if (!intervals.empty()) {
+        std::vector<uint32>::iterator p90 = intervals.begin() + intervals.size() * 9 / 10;
+        std::nth_element(intervals.begin(), p90, intervals.end());
+        stats_.advertising_interval_ms = *p90;
+    }
+
+    // smallest duty that misses an advertiser for the target latency in
+    // fewer than 5% of the cases
+    uint32 duty = 100;
+    if (stats_.advertising_interval_ms && config_.target_latency_ms) {
+        double tries = static_cast<double>(config_.target_latency_ms)
+                     / stats_.advertising_interval_ms;
+        duty = static_cast<uint32>(ceil(100.0 * (1.0 - pow(0.05, 1.0 / tries))));
+    }
+    if (stats_.new_devices && duty < stats_.duty) {
+        duty = stats_.duty;
+    }
+    uint32 connections = Connections();
+    uint32 cap = connections ? config_.connected_duty : 100;
+    duty = std::max<uint32>(config_.min_duty, std::min(duty, cap));
+    stats_.duty = duty;
+
+    ScanSchedule schedule;
+    schedule.interval = connections ? kConnectedInterval : kIdleInterval;
+    schedule.window = std::max<uint32>(kMinWindow, schedule.interval * duty / 100);
+    schedule.window = std::min(schedule.window, schedule.interval);
+    schedule.active = burst_end_ms_ != 0;
+
+    // some never answer, only new ones are worth another burst
+    if (missing < burst_missing_) {
+        burst_missing_ = missing;
+    }
+    if (!burst_end_ms_ && config_.missing_responses
+            && missing >= burst_missing_ + config_.missing_responses) {
+        burst_end_ms_ = now + config_.burst_ms;
+        burst_missing_ = missing;
+        schedule.active = true;
+        stats_.bursts++;
+    }
+
+    if (schedule.interval != current_.interval || schedule.window != current_.window
+            || schedule.active != current_.active) {
+        Apply(schedule);
+    }
+}
+
+
+/**
+ * @brief restarts discovery with new parameters, they only take effect
+ *        with ble_cmd_gap_discover
+ */
+void ScanScheduler::Apply(const ScanSchedule& schedule) {
+    current_ = schedule;
+    stats_.changes++;
+    Scanner::Stop();
+    Scanner::Start(schedule.interval, schedule.window, schedule.active);
+}
+
+
+void ScanScheduler::OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    if ((msg->flags & connection_connected) && !connected_[msg->connection]) {
+        connected_[msg->connection] = true;
+        // make room for the connection right away
+        next_plan_ms_ = 0;
+    }
+}
+
+
+void ScanScheduler::OnDisconnected(uint8 connection) {
+    if (connection < APP_MAX_CONNECTIONS && connected_[connection]) {
+        connected_[connection] = false;
+        next_plan_ms_ = 0;
+    }
+}
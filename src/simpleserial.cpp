@@ -27,6 +27,8 @@
 #include <string>
 
 #include "../inc/simpleserial.h"
+#include "../inc/eventexecutor.h"
+#include "../inc/handlerstats.h"
 
 
 ::bio::io_service*  SimpleSerial::io_srvc_  = nullptr;
@@ -110,7 +112,13 @@ int SimpleSerial::ReadBleMessage() {
 
     // run the handler for this message type.
     // the handler funcs are in command.c
+    uint64_t start_ns = HandlerStats::Now();
     api_msg->handler(data);
+    HandlerStats::Record(api_msg, api_header.lolen, start_ns);
+    HandlerStats::MaybeReport();
+
+    // heavier post-processing runs on the worker pool, not here
+    EventExecutor::Post(api_msg, data, api_header.lolen);
 
     return 0;
 }
@@ -130,5 +138,16 @@ void SimpleSerial::WriteBleMessage(uint8 len1, uint8* data1,
 }
 
 
+/**
+ * @brief SimpleSerial::WriteRaw writes already assembled BGAPI packets, used as
+ *        sink by the TxQueue writer thread
+ * @param data      one or more complete packets
+ * @param len       no. of byte to transmit
+ */
+void SimpleSerial::WriteRaw(const uint8* data, size_t len) {
+    bio::write(*srl_port_, bio::buffer(data, len));
+}
+
+
 
 
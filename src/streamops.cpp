@@ -0,0 +1,343 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+
+#include "../inc/streamops.h"
+#include "../inc/steadyclock.h"
+
+
+std::vector<StreamOperators::Pipeline> StreamOperators::pipelines_;
+
+
+StreamOp StreamOp::Decimate(uint32 n) {
+    StreamOp op = StreamOp();
+    op.type = kStreamDecimate;
+    op.factor = n ? n : 1;
+    return op;
+}
+
+
+StreamOp StreamOp::ChangeOnly(double dead_band) {
+    StreamOp op = StreamOp();
+    op.type = kStreamChangeOnly;
+    op.dead_band = dead_band;
+    return op;
+}
+
+
+StreamOp StreamOp::Tumbling(uint64_t window_us) {
+    StreamOp op = StreamOp();
+    op.type = kStreamTumbling;
+    op.window_us = window_us ? window_us : 1;
+    return op;
+}
+
+
+StreamOp StreamOp::Sliding(uint64_t window_us, uint32 capacity) {
+    StreamOp op = StreamOp();
+    op.type = kStreamSliding;
+    op.window_us = window_us;
+    op.factor = capacity ? capacity : 1;
+    return op;
+}
+
+
+/**
+ * @brief sets up the pipeline of a handle, replacing an earlier one
+ * @param schema    decodes the values of the handle
+ * @param field     field of the schema that is reduced
+ * @param ops       operators, applied in order
+ * @param sink      gets what leaves the last operator
+ * @return  false without a schema
+ */
+bool StreamOperators::Configure(uint8 connection, uint16 handle, const PayloadSchema* schema,
+                                size_t field, const std::vector<StreamOp>& ops,
+                                const stream_sink& sink) {
+    if (!schema || field >= schema->FieldCount()) {
+        return false;
+    }
+    Remove(connection, handle);
+
+    Pipeline p;
+    p.connection = connection;
+    p.handle = handle;
+    p.schema = schema;
+    p.field = field;
+    p.sink = sink;
+    p.stats = StreamStats();
+    for (size_t i = 0; i < ops.size(); i++) {
+        Stage stage = Stage();
+        stage.op = ops[i];
+        if (stage.op.type == kStreamSliding) {
+            stage.ring.resize(stage.op.factor);
+            stage.min_queue.seq.resize(stage.op.factor);
+            stage.max_queue.seq.resize(stage.op.factor);
+        }
+        p.stages.push_back(stage);
+    }
+    pipelines_.push_back(p);
+    return true;
+}
+
+
+void StreamOperators::Remove(uint8 connection, uint16 handle) {
+    for (size_t i = 0; i < pipelines_.size(); i++) {
+        if (pipelines_[i].connection == connection && pipelines_[i].handle == handle) {
+            pipelines_.erase(pipelines_.begin() + i);
+            return;
+        }
+    }
+}
+
+
+StreamOperators::Pipeline* StreamOperators::Find(uint8 connection, uint16 handle) {
+    for (size_t i = 0; i < pipelines_.size(); i++) {
+        if (pipelines_[i].connection == connection && pipelines_[i].handle == handle) {
+            return &pipelines_[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief feeds a notified or indicated value into the pipeline of its
+ *        handle, if there is one
+ */
+void StreamOperators::OnValue(uint8 connection, uint16 handle, const uint8* data, uint8 len) {
+    Pipeline* p = Find(connection, handle);
+    if (!p) {
+        return;
+    }
+
+    StreamSample sample;
+    if (!p->schema->DecodeField(data, len, p->field, &sample.value)) {
+        return;
+    }
+    sample.time_us = SteadyClock::Us();
+    sample.min = sample.value;
+    sample.max = sample.value;
+    sample.count = 1;
+    sample.sum = sample.value;
+    sample.fresh = 1;
+
+    p->stats.samples_in++;
+    Run(p, 0, sample);
+}
+
+
+/**
+ * @brief passes a sample through the operators from stage on
+ */
+void StreamOperators::Run(Pipeline* pipeline, size_t stage, const StreamSample& sample) {
+    if (stage == pipeline->stages.size()) {
+        pipeline->stats.samples_out++;
+        if (pipeline->sink) {
+            pipeline->sink(pipeline->connection, pipeline->handle, sample);
+        }
+        return;
+    }
+
+    Stage& s = pipeline->stages[stage];
+    switch (s.op.type) {
+    case kStreamDecimate:
+        if (s.seen++ % s.op.factor == 0) {
+            Run(pipeline, stage + 1, sample);
+        }
+        break;
+
+    case kStreamChangeOnly:
+        if (!s.has_last || sample.value - s.last > s.op.dead_band
+                || s.last - sample.value > s.op.dead_band) {
+            s.has_last = true;
+            s.last = sample.value;
+            Run(pipeline, stage + 1, sample);
+        }
+        break;
+
+    case kStreamTumbling: {
+        if (!sample.fresh) {
+            break;
+        }
+        uint64_t start = sample.time_us - sample.time_us % s.op.window_us;
+        if (s.window.count && start != s.window.time_us) {
+            Close(pipeline, stage);
+        }
+        if (!s.window.count) {
+            s.window = sample;
+            s.window.time_us = start;
+            s.window.count = sample.fresh;
+        } else {
+            s.window.min = sample.min < s.window.min ? sample.min : s.window.min;
+            s.window.max = sample.max > s.window.max ? sample.max : s.window.max;
+            s.window.count += sample.fresh;
+            s.window.sum += sample.sum;
+        }
+        break;
+    }
+
+    case kStreamSliding: {
+        StreamSample out;
+        Slide(&s, sample, &out);
+        Run(pipeline, stage + 1, out);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+
+/**
+ * @brief emits the open window of a tumbling stage
+ */
+void StreamOperators::Close(Pipeline* pipeline, size_t stage) {
+    Stage& s = pipeline->stages[stage];
+    StreamSample done = s.window;
+    done.value = done.sum / done.count;
+    done.fresh = done.count;
+    s.window.count = 0;
+    Run(pipeline, stage + 1, done);
+}
+
+
+/**
+ * @brief adds a sample to a sliding window
+ *
+ * Minimum and maximum come from monotonic queues, so each sample costs a
+ * constant amount of work on average however large the window is.
+ *
+ * @param out   summary of the window including the new sample
+ */
+void StreamOperators::Slide(Stage* stage, const StreamSample& in, StreamSample* out) {
+    Stage& s = *stage;
+    const size_t capacity = s.ring.size();
+    SeqQueue& minq = s.min_queue;
+    SeqQueue& maxq = s.max_queue;
+
+    // drop what fell out of the window or what the new sample pushes out
+    while (s.next_seq > s.first_seq) {
+        const StreamSample& oldest = s.ring[s.first_seq % capacity];
+        if (s.next_seq - s.first_seq < capacity
+                && oldest.time_us + s.op.window_us > in.time_us) {
+            break;
+        }
+        s.sum -= oldest.sum;
+        s.count -= oldest.fresh;
+        if (minq.size && minq.seq[minq.head] == s.first_seq) {
+            minq.head = (minq.head + 1) % capacity;
+            minq.size--;
+        }
+        if (maxq.size && maxq.seq[maxq.head] == s.first_seq) {
+            maxq.head = (maxq.head + 1) % capacity;
+            maxq.size--;
+        }
+        s.first_seq++;
+    }
+
+    const uint64_t seq = s.next_seq++;
+    s.ring[seq % capacity] = in;
+    s.sum += in.sum;
+    s.count += in.fresh;
+
+    while (minq.size
+           && s.ring[minq.seq[(minq.head + minq.size - 1) % capacity] % capacity].min >= in.min) {
+        minq.size--;
+    }
+    minq.seq[(minq.head + minq.size++) % capacity] = seq;
+    while (maxq.size
+           && s.ring[maxq.seq[(maxq.head + maxq.size - 1) % capacity] % capacity].max <= in.max) {
+        maxq.size--;
+    }
+    maxq.seq[(maxq.head + maxq.size++) % capacity] = seq;
+
+    out->time_us = s.ring[s.first_seq % capacity].time_us;
+    out->value = s.count ? s.sum / s.count : in.value;
+    out->min = s.ring[minq.seq[minq.head] % capacity].min;
+    out->max = s.ring[maxq.seq[maxq.head] % capacity].max;
+    out->count = static_cast<uint32>(s.count);
+    // overlaps the previous summaries, only the input is new
+    out->sum = in.sum;
+    out->fresh = in.fresh;
+}
+
+
+/**
+ * @brief emits the tumbling windows that are over, also when no sample
+ *        of a later window comes
+ */
+void StreamOperators::Poll() {
+    uint64_t now = SteadyClock::Us();
+    for (size_t i = 0; i < pipelines_.size(); i++) {
+        Pipeline* p = &pipelines_[i];
+        // upstream first, what it emits may still fall into an open window
+        for (size_t j = 0; j < p->stages.size(); j++) {
+            const Stage& s = p->stages[j];
+            if (s.op.type == kStreamTumbling && s.window.count
+                    && now >= s.window.time_us + s.op.window_us) {
+                Close(p, j);
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief emits the open tumbling windows of a connection
+ */
+void StreamOperators::Flush(uint8 connection) {
+    for (size_t i = 0; i < pipelines_.size(); i++) {
+        Pipeline* p = &pipelines_[i];
+        if (p->connection != connection) {
+            continue;
+        }
+        for (size_t j = 0; j < p->stages.size(); j++) {
+            if (p->stages[j].op.type == kStreamTumbling && p->stages[j].window.count) {
+                Close(p, j);
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief flushes and drops the pipelines of a connection, its handle may
+ *        belong to another device next time
+ */
+void StreamOperators::OnDisconnected(uint8 connection) {
+    Flush(connection);
+    for (size_t i = pipelines_.size(); i > 0; i--) {
+        if (pipelines_[i - 1].connection == connection) {
+            pipelines_.erase(pipelines_.begin() + (i - 1));
+        }
+    }
+}
+
+
+StreamStats StreamOperators::Stats(uint8 connection, uint16 handle) {
+    Pipeline* p = Find(connection, handle);
+    return p ? p->stats : StreamStats();
+}
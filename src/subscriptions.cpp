@@ -0,0 +1,235 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/subscriptions.h"
+#include "../inc/attributedb.h"
+#include "../inc/attscheduler.h"
+#include "../inc/gattcache.h"
+
+
+std::map<uint64_t, std::vector<SubscriptionManager::Wanted> > SubscriptionManager::wanted_;
+SubscriptionManager::Link SubscriptionManager::links_[APP_MAX_CONNECTIONS];
+
+
+uint64_t SubscriptionManager::Key(const bd_addr& device) {
+    uint64_t address = 0;
+    for (int i = 5; i >= 0; i--) {
+        address = (address << 8) | device.addr[i];
+    }
+    return address;
+}
+
+
+/**
+ * @brief remembers that a characteristic of a device should notify or
+ *        indicate; takes effect with the next Apply() or reconnect
+ * @param device    address of the device
+ * @param uuid      characteristic UUID, little endian
+ * @param len       2 or 16
+ * @param mode      SubscriptionMode, kSubscribeNone writes 0 to the CCCD
+ */
+void SubscriptionManager::Subscribe(const bd_addr& device, const uint8* uuid, uint8 len,
+                                    uint8 mode) {
+    std::vector<Wanted>& wanted = wanted_[Key(device)];
+    Uuid id = Uuid::FromBytes(uuid, len);
+
+    for (size_t i = 0; i < wanted.size(); i++) {
+        if (Uuid::FromBytes(wanted[i].uuid, wanted[i].uuid_len) == id) {
+            wanted[i].mode = mode;
+            return;
+        }
+    }
+
+    Wanted w;
+    w.uuid_len = len < sizeof(w.uuid) ? len : sizeof(w.uuid);
+    memcpy(w.uuid, uuid, w.uuid_len);
+    w.mode = mode;
+    wanted.push_back(w);
+}
+
+
+/**
+ * @brief forgets a subscription, the CCCD on the device is left alone
+ */
+void SubscriptionManager::Unsubscribe(const bd_addr& device, const uint8* uuid, uint8 len) {
+    std::map<uint64_t, std::vector<Wanted> >::iterator it = wanted_.find(Key(device));
+    if (it == wanted_.end()) {
+        return;
+    }
+    Uuid id = Uuid::FromBytes(uuid, len);
+    std::vector<Wanted>& wanted = it->second;
+    for (size_t i = 0; i < wanted.size(); i++) {
+        if (Uuid::FromBytes(wanted[i].uuid, wanted[i].uuid_len) == id) {
+            wanted.erase(wanted.begin() + i);
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief writes the CCCDs of all subscriptions of the connected device
+ * @param connection    connection handle
+ * @param done          called once all writes finished, may be empty
+ * @return  false if the connection is unknown or already applying
+ */
+bool SubscriptionManager::Apply(uint8 connection, const subscribe_done& done) {
+    if (connection >= APP_MAX_CONNECTIONS || !links_[connection].connected
+            || links_[connection].outstanding) {
+        return false;
+    }
+    Link& link = links_[connection];
+
+    AttributeDb* db = AttributeDb::ForConnection(connection);
+    const std::vector<GattAttribute>* attributes = GattCache::Attributes(connection);
+    if (db->Empty() && attributes && !attributes->empty()) {
+        db->Build(*attributes);
+    }
+
+    link.written = 0;
+    link.result = 0;
+    link.done = done;
+
+    // held while queueing, so a write failing right away cannot report early
+    link.outstanding = 1;
+    uint32 missing = 0;
+    std::map<uint64_t, std::vector<Wanted> >::const_iterator it = wanted_.find(link.address);
+    if (it != wanted_.end()) {
+        const std::vector<Wanted>& wanted = it->second;
+        for (size_t i = 0; i < wanted.size(); i++) {
+            uint16 cccd = db->CccdHandle(wanted[i].uuid, wanted[i].uuid_len);
+            if (!cccd) {
+                missing++;
+                continue;
+            }
+
+            uint8 mode = wanted[i].mode;
+            AttOp op = AttOp();
+            op.priority = kAttPriorityHigh;
+            op.completion = kAttCompletesOnProcedure;
+            op.issue = [cccd, mode](uint8 c) {
+                uint8 value[2] = { mode, 0x00 };
+                ble_cmd_attclient_attribute_write(c, cccd, sizeof(value), value);
+            };
+            op.done = [connection](uint16 result) {
+                Written(connection, result);
+            };
+
+            link.outstanding++;
+            AttScheduler::Submit(connection, op);
+        }
+    }
+
+    link.missing = missing;
+    Written(connection, kResultQueued);
+    return true;
+}
+
+
+/**
+ * @return  true while CCCD writes of the connection are pending
+ */
+bool SubscriptionManager::IsApplying(uint8 connection) {
+    return connection < APP_MAX_CONNECTIONS && links_[connection].outstanding;
+}
+
+
+void SubscriptionManager::Written(uint8 connection, uint16 result) {
+    Link& link = links_[connection];
+    link.outstanding--;
+    if (result == kResultQueued) {
+        // the guard taken by Apply()
+    } else if (result) {
+        if (!link.result) {
+            link.result = result;
+        }
+    } else {
+        link.written++;
+    }
+
+    if (!link.outstanding) {
+        printf("[#] Subscriptions of connection %d: %lu written, %lu without CCCD\n",
+               connection, link.written, link.missing);
+        subscribe_done done;
+        done.swap(link.done);
+        if (done) {
+            done(link.result, link.written, link.missing);
+        }
+    }
+}
+
+
+/**
+ * @brief a reconnecting device with a cached layout gets its subscriptions
+ *        back right away
+ */
+void SubscriptionManager::OnConnectionStatus(const struct ble_msg_connection_status_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    if (!(msg->flags & connection_connected)) {
+        return;
+    }
+
+    Link& link = links_[msg->connection];
+    uint64_t address = Key(msg->address);
+    // parameter updates of a known link
+    if (link.connected && link.address == address) {
+        return;
+    }
+
+    link.connected = true;
+    link.address = address;
+    link.outstanding = 0;
+
+    if (GattCache::IsHit(msg->connection) && wanted_.count(address)) {
+        Apply(msg->connection, subscribe_done());
+    }
+}
+
+
+void SubscriptionManager::OnDisconnected(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS) {
+        return;
+    }
+    // pending writes are failed by AttScheduler
+    links_[connection].connected = false;
+}
+
+
+/**
+ * @brief to be called once discovery built the connection's database
+ */
+void SubscriptionManager::OnDatabaseReady(uint8 connection) {
+    if (connection >= APP_MAX_CONNECTIONS || !links_[connection].connected) {
+        return;
+    }
+    if (wanted_.count(links_[connection].address)) {
+        Apply(connection, subscribe_done());
+    }
+}
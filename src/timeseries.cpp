@@ -0,0 +1,411 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <chrono>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "../inc/timeseries.h"
+
+
+namespace bip = ::boost::interprocess;
+
+
+/* Segment file header, followed by the time column and the value column.
+ * Written as is, so only fixed width fields (little endian hosts). */
+struct SegmentHeader {
+    char magic[4];
+    uint8_t version;
+    uint8_t encoding;       // SegmentEncoding
+    uint8_t width;          // value bytes for kEncodingInteger
+    uint8_t reserved;
+    uint32_t count;
+    uint32_t time_bytes;
+    uint32_t value_bytes;
+    uint32_t reserved2;
+    uint64_t first_time;
+};
+
+static_assert(sizeof(SegmentHeader) == 32, "segment header layout is part of the file format");
+
+enum SegmentEncoding {
+    kEncodingInteger = 0,   // zigzag varint delta of a little endian integer
+    kEncodingRaw = 1        // varint length, bytes
+};
+
+static const char  kMagic[4] = { 'T', 'S', 'E', 'G' };
+// 2: fixed width header, 1 used the platform's long
+static const uint8 kVersion  = 2;
+
+
+/**
+ * @brief offset from steady clock to wall clock time, taken once before
+ *        main() so the workers calling Append() only ever read it
+ */
+static int64_t SteadyToWallUs() {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    return duration_cast<microseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
+           - duration_cast<microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+std::string TimeSeries::directory_ = ".timeseries";
+std::map<TimeSeries::SeriesKey, TimeSeries::Series> TimeSeries::series_;
+TimeSeriesStats TimeSeries::stats_;
+int64_t TimeSeries::steady_to_wall_us_ = SteadyToWallUs();
+std::mutex TimeSeries::mutex_;
+
+
+static inline uint64_t ZigZag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+
+static inline int64_t UnZigZag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+
+static inline void PutVarint(std::vector<uint8>* out, uint64_t v) {
+    while (v >= 0x80) {
+        out->push_back(static_cast<uint8>(v) | 0x80);
+        v >>= 7;
+    }
+    out->push_back(static_cast<uint8>(v));
+}
+
+
+static inline bool GetVarint(const uint8** p, const uint8* end, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8 byte = *(*p)++;
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief decodes one segment and hands each sample to visit
+ * @return  number of samples decoded
+ */
+static uint64_t Decode(const SegmentHeader& header,
+                       const uint8* times, const uint8* times_end,
+                       const uint8* values, const uint8* values_end,
+                       const sample_visitor& visit) {
+    uint64_t time = header.first_time;
+    uint64_t value = 0;
+    uint8 buffer[256];
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        uint64_t v;
+        if (!GetVarint(&times, times_end, &v)) {
+            return i;
+        }
+        time += UnZigZag(v);
+
+        if (header.encoding == kEncodingInteger) {
+            if (!GetVarint(&values, values_end, &v)) {
+                return i;
+            }
+            value += static_cast<uint64_t>(UnZigZag(v));
+            for (uint8 b = 0; b < header.width; b++) {
+                buffer[b] = value >> (8 * b);
+            }
+            visit(time, buffer, header.width);
+        } else {
+            if (!GetVarint(&values, values_end, &v)
+                    || v > sizeof(buffer) || static_cast<uint64_t>(values_end - values) < v) {
+                return i;
+            }
+            visit(time, values, v);
+            values += v;
+        }
+    }
+    return header.count;
+}
+
+
+/**
+ * @brief sets (and creates) the directory holding the segment files, open
+ *        segments are written to the previous one first
+ */
+void TimeSeries::SetDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<SeriesKey, Series>::iterator it = series_.begin();
+         it != series_.end(); ++it) {
+        Seal(it->first, &it->second);
+    }
+    series_.clear();
+    directory_ = directory;
+#ifdef _WIN32
+    _mkdir(directory_.c_str());
+#else
+    mkdir(directory_.c_str(), 0755);
+#endif
+}
+
+
+TimeSeries::SeriesKey TimeSeries::Key(const bd_addr& device, uint16 handle) {
+    uint64_t address = 0;
+    for (int i = 5; i >= 0; i--) {
+        address = (address << 8) | device.addr[i];
+    }
+    return SeriesKey(address, handle);
+}
+
+
+/**
+ * @return  path of a segment, e.g. ".timeseries/0007806af289-0010-000003.ts"
+ */
+std::string TimeSeries::FileName(const SeriesKey& key, uint32 segment) {
+    char name[48];
+    snprintf(name, sizeof(name), "%012llx-%04x-%06lu.ts",
+             static_cast<unsigned long long>(key.first), key.second, segment);
+    return directory_ + "/" + name;
+}
+
+
+/**
+ * @brief finds a series, a new one continues behind the segments on disk
+ */
+TimeSeries::Series& TimeSeries::Open(const SeriesKey& key) {
+    std::map<SeriesKey, Series>::iterator it = series_.find(key);
+    if (it != series_.end()) {
+        return it->second;
+    }
+
+    Series& series = series_[key];
+    series.next_segment = 0;
+    series.count = 0;
+
+    struct stat st;
+    while (stat(FileName(key, series.next_segment).c_str(), &st) == 0) {
+        series.next_segment++;
+    }
+    return series;
+}
+
+
+/**
+ * @brief appends one sample
+ * @param device    address of the device
+ * @param handle    attribute handle
+ * @param time_us   microseconds since the epoch
+ * @param data      value, as sent by the device
+ * @param len       value length
+ */
+void TimeSeries::Append(const bd_addr& device, uint16 handle, uint64_t time_us,
+                        const uint8* data, uint8 len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SeriesKey key = Key(device, handle);
+    Series& series = Open(key);
+
+    uint8 encoding = (len >= 1 && len <= 8) ? kEncodingInteger : kEncodingRaw;
+    if (series.count && (encoding != series.encoding
+            || (encoding == kEncodingInteger && len != series.width))) {
+        Seal(key, &series);
+    }
+    if (!series.count) {
+        series.encoding = encoding;
+        series.width = encoding == kEncodingInteger ? len : 0;
+        series.first_time = time_us;
+        series.last_time = time_us;
+        series.last_value = 0;
+    }
+
+    PutVarint(&series.times, ZigZag(time_us - series.last_time));
+    series.last_time = time_us;
+
+    if (encoding == kEncodingInteger) {
+        uint64_t value = 0;
+        for (int b = len - 1; b >= 0; b--) {
+            value = (value << 8) | data[b];
+        }
+        PutVarint(&series.values, ZigZag(static_cast<int64_t>(value - series.last_value)));
+        series.last_value = value;
+    } else {
+        PutVarint(&series.values, len);
+        series.values.insert(series.values.end(), data, data + len);
+    }
+
+    series.count++;
+    stats_.samples++;
+    stats_.raw_bytes += 8 + len;
+
+    if (series.count >= kSamplesPerSegment) {
+        Seal(key, &series);
+    }
+}
+
+
+/**
+ * @brief appends a notification taken from NotificationRing
+ */
+void TimeSeries::Append(const bd_addr& device, const Notification& notification) {
+    Append(device, notification.handle,
+           notification.timestamp_ns / 1000 + steady_to_wall_us_,
+           notification.data, notification.len);
+}
+
+
+/**
+ * @brief writes the open segment of a series to its file
+ */
+bool TimeSeries::Seal(const SeriesKey& key, Series* series) {
+    if (!series->count) {
+        return true;
+    }
+
+    SegmentHeader header = SegmentHeader();
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.encoding = series->encoding;
+    header.width = series->width;
+    header.count = series->count;
+    header.time_bytes = series->times.size();
+    header.value_bytes = series->values.size();
+    header.first_time = series->first_time;
+
+    std::string path = FileName(key, series->next_segment);
+    std::string tmp = path + ".tmp";
+
+    bool ok = false;
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (f) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1
+             && fwrite(&series->times[0], 1, header.time_bytes, f) == header.time_bytes
+             && fwrite(&series->values[0], 1, header.value_bytes, f) == header.value_bytes;
+        ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+        if (!ok) {
+            remove(tmp.c_str());
+        }
+    }
+
+    if (ok) {
+        stats_.stored_bytes += sizeof(header) + header.time_bytes + header.value_bytes;
+        stats_.segments++;
+        series->next_segment++;
+    }
+
+    // the samples are gone either way, the series must go on
+    series->count = 0;
+    series->times.clear();
+    series->values.clear();
+    return ok;
+}
+
+
+/**
+ * @brief writes every open segment
+ * @return  false if a segment could not be written
+ */
+bool TimeSeries::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool ok = true;
+    for (std::map<SeriesKey, Series>::iterator it = series_.begin();
+         it != series_.end(); ++it) {
+        ok = Seal(it->first, &it->second) && ok;
+    }
+    return ok;
+}
+
+
+/**
+ * @brief visits all samples of a series in the order they were appended,
+ *        the written segments first, then the open one
+ * @return  number of samples visited
+ */
+uint64_t TimeSeries::Scan(const bd_addr& device, uint16 handle, const sample_visitor& visit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SeriesKey key = Key(device, handle);
+    uint64_t samples = 0;
+
+    for (uint32 segment = 0; ; segment++) {
+        std::string path = FileName(key, segment);
+        try {
+            bip::file_mapping file(path.c_str(), bip::read_only);
+            bip::mapped_region region(file, bip::read_only);
+
+            const uint8* base = static_cast<const uint8*>(region.get_address());
+            size_t size = region.get_size();
+
+            SegmentHeader header;
+            if (size < sizeof(header)) {
+                continue;
+            }
+            memcpy(&header, base, sizeof(header));
+            if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+                    || header.version != kVersion
+                    || size < sizeof(header) + header.time_bytes + header.value_bytes) {
+                continue;
+            }
+
+            const uint8* times = base + sizeof(header);
+            const uint8* values = times + header.time_bytes;
+            samples += Decode(header, times, values, values, values + header.value_bytes, visit);
+        } catch(const bip::interprocess_exception&) {
+            // no more segments
+            break;
+        }
+    }
+
+    std::map<SeriesKey, Series>::const_iterator it = series_.find(key);
+    if (it != series_.end() && it->second.count) {
+        const Series& series = it->second;
+        SegmentHeader header = SegmentHeader();
+        header.encoding = series.encoding;
+        header.width = series.width;
+        header.count = series.count;
+        header.first_time = series.first_time;
+        samples += Decode(header, &series.times[0], &series.times[0] + series.times.size(),
+                          &series.values[0], &series.values[0] + series.values.size(), visit);
+    }
+    return samples;
+}
+
+
+/**
+ * @return  sample and byte counters, stored_bytes / raw_bytes is the
+ *          compression ratio
+ */
+TimeSeriesStats TimeSeries::Stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,305 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../inc/txqueue.h"
+
+
+std::atomic<TxQueue::TxFrame*> TxQueue::head_(&TxQueue::stub_);
+TxQueue::TxFrame* TxQueue::tail_ = &TxQueue::stub_;
+TxQueue::TxFrame TxQueue::stub_;
+
+TxQueue::TxFrame TxQueue::pool_[kPoolFrames];
+std::atomic<uint64_t> TxQueue::free_(0);
+std::atomic<bool> TxQueue::pool_ready_(false);
+
+std::atomic<bool> TxQueue::running_(false);
+std::atomic<bool> TxQueue::writer_idle_(false);
+std::atomic<uint32> TxQueue::frames_(0);
+std::atomic<uint32> TxQueue::batches_(0);
+std::atomic<uint32> TxQueue::bytes_(0);
+std::atomic<uint32> TxQueue::dropped_(0);
+std::atomic<uint32> TxQueue::pending_(0);
+tx_sink TxQueue::sink_ = nullptr;
+
+// the writer only sleeps on these when the queue is empty
+static std::thread*            writer_ = nullptr;
+static std::mutex              wake_mutex_;
+static std::condition_variable wake_cv_;
+
+
+/**
+ * @brief starts the writer thread
+ * @param sink  function that writes a batch of bytes to the dongle
+ */
+void TxQueue::Start(tx_sink sink) {
+    if (running_) {
+        return;
+    }
+    sink_ = sink;
+    InitPool();
+    running_ = true;
+    writer_ = new std::thread(WriterLoop);
+}
+
+
+/**
+ * @brief writes what is still queued and stops the writer thread
+ */
+void TxQueue::Stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    WakeWriter();
+    writer_->join();
+    delete writer_;
+    writer_ = nullptr;
+}
+
+
+/**
+ * @brief blocks until every frame submitted so far has been written
+ */
+void TxQueue::Flush() {
+    while (running_ && pending_.load() != 0) {
+        std::this_thread::yield();
+    }
+}
+
+
+/**
+ * @brief copies a BGAPI packet into the queue, replaces the direct write as
+ *        bglib_output. Safe to call from any number of threads.
+ * @param len1      no. of byte in data1 (header and fixed parameters)
+ * @param data1     first chunk of data to send
+ * @param len2      no. of byte in data2 (variable length parameter)
+ * @param data2     second chunk of data to send
+ */
+void TxQueue::Submit(uint8 len1, uint8* data1, uint16 len2, uint8* data2) {
+    if (static_cast<size_t>(len1) + len2 > kMaxFrame) {
+        dropped_++;
+        return;
+    }
+
+    TxFrame* frame = Allocate();
+    memcpy(frame->data, data1, len1);
+    if (len2) {
+        memcpy(frame->data + len1, data2, len2);
+    }
+    frame->len = len1 + len2;
+
+    pending_++;
+    Push(frame);
+
+    if (writer_idle_.load()) {
+        WakeWriter();
+    }
+}
+
+
+/**
+ * @brief links all frames into the free list, once
+ */
+void TxQueue::InitPool() {
+    if (pool_ready_) {
+        return;
+    }
+    for (uint32_t i = 0; i < kPoolFrames; i++) {
+        pool_[i].next_free.store(i + 1 < kPoolFrames ? i + 2 : 0, std::memory_order_relaxed);
+    }
+    free_.store(1);
+    pool_ready_ = true;
+}
+
+
+/**
+ * @brief takes a frame from the pool, waits for the writer if it is empty
+ */
+TxQueue::TxFrame* TxQueue::Allocate() {
+    uint64_t top = free_.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t index = static_cast<uint32_t>(top);
+        if (!index) {
+            WakeWriter();
+            std::this_thread::yield();
+            top = free_.load(std::memory_order_acquire);
+            continue;
+        }
+        TxFrame* frame = &pool_[index - 1];
+        uint64_t next = ((top >> 32) + 1) << 32
+                        | frame->next_free.load(std::memory_order_relaxed);
+        if (free_.compare_exchange_weak(top, next, std::memory_order_acq_rel)) {
+            return frame;
+        }
+    }
+}
+
+
+/**
+ * @brief puts a written frame back into the pool
+ */
+void TxQueue::Release(TxFrame* frame) {
+    uint32_t index = static_cast<uint32_t>(frame - pool_) + 1;
+    uint64_t top = free_.load(std::memory_order_acquire);
+    do {
+        frame->next_free.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+    } while (!free_.compare_exchange_weak(top, ((top >> 32) + 1) << 32 | index,
+                                          std::memory_order_acq_rel));
+}
+
+
+/**
+ * @brief wait-free enqueue, one exchange per frame
+ */
+void TxQueue::Push(TxFrame* frame) {
+    frame->next.store(nullptr, std::memory_order_relaxed);
+    TxFrame* prev = head_.exchange(frame, std::memory_order_acq_rel);
+    // between the exchange and this store the list is briefly disconnected,
+    // Pop() treats that as empty and the writer simply comes back later
+    prev->next.store(frame, std::memory_order_release);
+}
+
+
+/**
+ * @brief dequeue, must only be called from the writer thread
+ * @return  the oldest frame or nullptr
+ */
+TxQueue::TxFrame* TxQueue::Pop() {
+    TxFrame* tail = tail_;
+    TxFrame* next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &stub_) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+
+    if (tail != head_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // tail is the last frame, put the stub behind it so it can be taken
+    Push(&stub_);
+
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+
+/**
+ * @brief moves queued frames to the sink, several frames per write
+ * @return  no. of frames written
+ */
+size_t TxQueue::Drain() {
+    uint8 batch[kMaxBatch];
+    size_t fill = 0;
+    size_t count = 0;
+    TxFrame* frame;
+
+    while ((frame = Pop()) != nullptr) {
+        if (fill + frame->len > kMaxBatch) {
+            sink_(batch, fill);
+            batches_++;
+            fill = 0;
+        }
+        memcpy(batch + fill, frame->data, frame->len);
+        fill += frame->len;
+        bytes_ += frame->len;
+        frames_++;
+        count++;
+        Release(frame);
+    }
+
+    if (fill) {
+        sink_(batch, fill);
+        batches_++;
+    }
+
+    pending_ -= count;
+    return count;
+}
+
+
+/**
+ * @brief body of the writer thread
+ */
+void TxQueue::WriterLoop() {
+    while (running_) {
+        if (Drain()) {
+            continue;
+        }
+
+        // announce the nap first, then look again so no Submit() is missed
+        writer_idle_ = true;
+        if (!Drain()) {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_cv_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        writer_idle_ = false;
+    }
+
+    Drain();
+}
+
+
+/**
+ * @brief wakes the writer if it is waiting for work
+ */
+void TxQueue::WakeWriter() {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_cv_.notify_one();
+}
+
+
+/**
+ * @return  output counters
+ */
+TxQueueStats TxQueue::Stats() {
+    TxQueueStats stats;
+    stats.frames  = frames_;
+    stats.batches = batches_;
+    stats.bytes   = bytes_;
+    stats.dropped = dropped_;
+    return stats;
+}
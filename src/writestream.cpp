@@ -0,0 +1,240 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Simon Wiesmann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h>
+
+#include "../inc/writestream.h"
+#include "../inc/attscheduler.h"
+#include "../inc/steadyclock.h"
+
+
+WriteStream::Link WriteStream::links_[APP_MAX_CONNECTIONS];
+
+
+/**
+ * @brief starts streaming data to a characteristic
+ * @param connection    connection handle
+ * @param handle        value handle, must accept write without response
+ * @param data          the stream, must not change until done is called
+ * @param done          called once with 0 or the first error and the stats
+ * @return  false if a stream is already running on the connection
+ */
+bool WriteStream::Start(uint8 connection, uint16 handle, const chain_buffer_ptr& data,
+                        const stream_done& done) {
+    if (connection >= APP_MAX_CONNECTIONS || links_[connection].active || !data) {
+        return false;
+    }
+
+    Link& link = links_[connection];
+    link.active = true;
+    link.sending = false;
+    link.backoff = false;
+    link.retry_ns = 0;
+    link.handle = handle;
+    link.data = data;
+    link.offset = 0;
+    link.unconfirmed = 0;
+    link.window = 2;
+    link.stats = WriteStreamStats();
+    link.stats.max_window = 2;
+    link.start_ns = SteadyClock::Ns();
+    link.done = done;
+
+    Pump(connection);
+    return true;
+}
+
+
+/**
+ * @return  true while a stream of the connection has not finished
+ */
+bool WriteStream::IsRunning(uint8 connection) {
+    return connection < APP_MAX_CONNECTIONS && links_[connection].active;
+}
+
+
+/**
+ * @brief resends packets whose refusal left nothing to wait for, call
+ *        regularly, e.g. after each ReadBleMessage()
+ */
+void WriteStream::Poll() {
+    uint64_t now = SteadyClock::Ns();
+    for (uint8 c = 0; c < APP_MAX_CONNECTIONS; c++) {
+        Link& link = links_[c];
+        if (link.active && link.backoff && link.retry_ns && now >= link.retry_ns) {
+            link.backoff = false;
+            link.retry_ns = 0;
+            Pump(c);
+        }
+    }
+}
+
+
+/**
+ * @brief hands the next packet to the dongle if the window allows it
+ */
+void WriteStream::Pump(uint8 connection) {
+    Link& link = links_[connection];
+    if (!link.active || link.sending || link.backoff) {
+        return;
+    }
+
+    if (link.offset >= link.data->Size()) {
+        if (!link.unconfirmed) {
+            Finish(connection, 0);
+        }
+        return;
+    }
+    if (link.unconfirmed >= static_cast<uint32>(link.window)) {
+        return;
+    }
+
+    uint32 offset = link.offset;
+    size_t left = link.data->Size() - offset;
+    uint8 len = left < kPacketSize ? left : kPacketSize;
+    uint16 handle = link.handle;
+    chain_buffer_ptr data = link.data;
+
+    AttOp op = AttOp();
+    op.priority = kAttPriorityNormal;
+    op.completion = kAttCompletesOnResponse;
+    op.issue = [handle, data, offset, len](uint8 c) {
+        uint8 packet[kPacketSize];
+        data->CopyOut(offset, packet, len);
+        ble_cmd_attclient_write_command(c, handle, len, packet);
+    };
+    op.done = [connection, len](uint16 result) {
+        Sent(connection, len, result);
+    };
+
+    link.sending = true;
+    AttScheduler::Submit(connection, op);
+}
+
+
+/**
+ * @brief books the response to a write_command
+ */
+void WriteStream::Sent(uint8 connection, uint8 len, uint16 result) {
+    Link& link = links_[connection];
+    if (!link.active) {
+        return;
+    }
+    link.sending = false;
+
+    if (result == kResultOutOfMemory || result == kResultFlow) {
+        // the dongle is full: halve the window, send the packet again once
+        // one of the buffered ones went out. If none of ours is buffered
+        // no confirmation will come, Poll() retries after a pause instead.
+        link.stats.retries++;
+        if (!link.backoff) {
+            link.stats.window_cuts++;
+            link.window = link.window / 2 < 1 ? 1 : link.window / 2;
+        }
+        link.backoff = true;
+        link.retry_ns = link.unconfirmed ? 0 : SteadyClock::Ns() + kRetryMs * 1000000ULL;
+        return;
+    } else if (result) {
+        Finish(connection, result);
+        return;
+    } else {
+        link.offset += len;
+        link.unconfirmed++;
+        link.stats.packets++;
+        link.stats.bytes += len;
+    }
+
+    Pump(connection);
+}
+
+
+/**
+ * @brief a buffered packet went out over the air: open the window a little
+ * @return  true if the event belonged to a stream, it must not be passed on
+ */
+bool WriteStream::OnProcedureCompleted(const struct ble_msg_attclient_procedure_completed_evt_t* msg) {
+    if (msg->connection >= APP_MAX_CONNECTIONS) {
+        return false;
+    }
+    Link& link = links_[msg->connection];
+    if (!link.active || msg->chrhandle != link.handle || !link.unconfirmed) {
+        return false;
+    }
+
+    link.unconfirmed--;
+    link.backoff = false;
+    link.retry_ns = 0;
+    if (msg->result) {
+        Finish(msg->connection, msg->result);
+        return true;
+    }
+
+    link.window += 1.0 / link.window;
+    if (link.window > kMaxWindow) {
+        link.window = kMaxWindow;
+    }
+    if (static_cast<uint32>(link.window) > link.stats.max_window) {
+        link.stats.max_window = static_cast<uint32>(link.window);
+    }
+
+    Pump(msg->connection);
+    return true;
+}
+
+
+/**
+ * @brief ends a stream whose link went away
+ */
+void WriteStream::OnDisconnected(uint8 connection) {
+    if (IsRunning(connection)) {
+        Finish(connection, AttScheduler::kResultNotConnected);
+    }
+}
+
+
+/**
+ * @brief reports the stream
+ */
+void WriteStream::Finish(uint8 connection, uint16 result) {
+    Link& link = links_[connection];
+    link.active = false;
+    link.data.reset();
+
+    link.stats.seconds = (SteadyClock::Ns() - link.start_ns) / 1e9;
+    link.stats.bytes_per_second = link.stats.seconds > 0
+            ? link.stats.bytes / link.stats.seconds : 0;
+
+    printf("[#] Stream on connection %d: %llu bytes in %.2f s, %.0f bytes/s, "
+           "window up to %lu, %lu retries\n",
+           connection, static_cast<unsigned long long>(link.stats.bytes),
+           link.stats.seconds, link.stats.bytes_per_second,
+           link.stats.max_window, link.stats.retries);
+
+    stream_done done;
+    done.swap(link.done);
+    if (done) {
+        done(result, link.stats);
+    }
+}